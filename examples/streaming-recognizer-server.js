@@ -0,0 +1,86 @@
+// Minimal stand-in for a streaming recognition server, for local testing
+//
+// Usage: node examples/streaming-recognizer-server.js [port] [flags]
+//   --no-final     end the responses without a final result, so the detector
+//                  delivers the last interim one as final
+//   --delay=<ms>   wait before the final result, e.g. to exceed
+//                  http_timeout_ms
+//
+// Point the detector's streaming_recognizer_url at
+// http://127.0.0.1:<port>/ (default port 8080). Every request gets an interim
+// result per 500 ms of received audio, describing how much audio arrived so
+// far, and a final result once the body ends.
+const http = require("http");
+
+const args = process.argv.slice(2);
+const port = Number(args.find(arg => /^\d+$/.test(arg)) || 8080);
+const sendFinal = !args.includes("--no-final");
+const delayArg = args.find(arg => arg.startsWith("--delay="));
+const finalDelayMs = delayArg ? Number(delayArg.split("=")[1]) : 0;
+
+// 16-bit mono PCM at 16 kHz
+const bytesPerMs = (16000 * 2) / 1000;
+const interimIntervalBytes = 500 * bytesPerMs;
+
+let nextRequestId = 1;
+
+const server = http.createServer((req, res) => {
+  const requestId = nextRequestId++;
+  const startTime = Date.now();
+  const log = message =>
+    console.log(`[${requestId}] +${Date.now() - startTime}ms ${message}`);
+
+  if (req.method !== "POST") {
+    res.writeHead(405);
+    res.end();
+    return;
+  }
+
+  log(`${req.headers["content-type"]}, ${req.headers["transfer-encoding"]}`);
+  res.writeHead(200, { "Content-Type": "application/x-ndjson" });
+
+  let receivedBytes = 0;
+  let nextInterimBytes = interimIntervalBytes;
+  const transcript = bytes => `${Math.round(bytes / bytesPerMs)} ms`;
+
+  // The chunks arrive as the audio is spoken, with gaps while the detector's
+  // upload is paused
+  req.on("data", chunk => {
+    receivedBytes += chunk.length;
+    log(`received ${chunk.length} bytes`);
+
+    while (receivedBytes >= nextInterimBytes) {
+      res.write(
+        JSON.stringify({
+          transcript: transcript(nextInterimBytes),
+          is_final: false
+        }) + "\n"
+      );
+      nextInterimBytes += interimIntervalBytes;
+    }
+  });
+
+  req.on("end", () => {
+    log(`body ended after ${receivedBytes} bytes`);
+
+    setTimeout(() => {
+      if (sendFinal) {
+        res.write(
+          JSON.stringify({
+            transcript: transcript(receivedBytes),
+            is_final: true,
+            confidence: 1
+          }) + "\n"
+        );
+      }
+      res.end();
+      log(
+        sendFinal ? "sent the final result" : "ended without a final result"
+      );
+    }, finalDelayMs);
+  });
+});
+
+server.listen(port, "127.0.0.1", () => {
+  console.log(`Streaming recognizer stand-in listening on port ${port}`);
+});
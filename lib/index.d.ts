@@ -1,3 +1,85 @@
+export interface DetectorOptions {
+  ingest_ring_size?: number;
+  ingest_overflow_policy?: "spill" | "drop";
+  stream_idle_ttl_ms?: number;
+  pv_prewarm_count?: number;
+  hotword_max_backlog_ms?: number;
+  command_audio_mode?: "reencode" | "passthrough";
+  streaming_recognizer_url?: string;
+  recognizer?: "google" | "http" | "loopback";
+  recognizer_url?: string;
+  loopback_latency_ms?: number;
+  loopback_transcript?: string;
+  realtime_threads?: number;
+  bulk_threads?: number;
+  vad_enabled?: boolean;
+  vad_end_silence_ms?: number;
+  stream_max_backlog_ms?: number;
+  max_backlog_ms?: number;
+  trace_path?: string;
+}
+
+export type IngestStatus = "ok" | "overloaded" | "dropped";
+
+export interface CommandWord {
+  word: string;
+  // Offsets in seconds from the start of the command audio
+  startTime: number;
+  endTime: number;
+}
+
+export interface CommandInfo {
+  isFinal: boolean;
+  traceId: number;
+  status: "ok" | "empty" | "error";
+  confidence?: number;
+  words: CommandWord[];
+  error?: string;
+}
+
+// Latencies are in microseconds
+export interface LatencyStats {
+  count: number;
+  mean: number;
+  max: number;
+  p50: number;
+  p90: number;
+  p99: number;
+  p999: number;
+}
+
+export interface QueueStats {
+  // Tasks waiting for a worker
+  depth: number;
+  // Tasks run so far and their total and max queue wait in microseconds
+  tasks: number;
+  totalWait: number;
+  maxWait: number;
+}
+
+export interface DetectorStats {
+  streams: number;
+  backlogMs: number;
+  queues: {
+    realtime: QueueStats;
+    bulk: QueueStats;
+  };
+  counters: {
+    framesReceived: number;
+    framesDropped: number;
+    hotwordsDetected: number;
+    commandsCompleted: number;
+    commandErrors: number;
+  };
+  latencies: {
+    opusDecode: LatencyStats;
+    hotwordCheck: LatencyStats;
+    commandEncode: LatencyStats;
+    recognizerRoundTrip: LatencyStats;
+    hotwordToCallback: LatencyStats;
+  };
+}
+
 export default class Detector {
   constructor(
     pv_model_path: string,
@@ -7,7 +89,22 @@ export default class Detector {
     max_voice_buffer_ttl: number,
     max_command_length: number,
     max_command_silence_length_ms: number,
-    callback: (id: string, command: string) => void
+    callback: (id: string, command: string, info: CommandInfo) => void,
+    options?: DetectorOptions
   );
-  addOpusFrame: (id: string, opusFrameBuffer: Buffer) => void;
+  addOpusFrame: (id: string, opusFrameBuffer: Buffer) => IngestStatus;
+  addOpusFrames: (
+    ids: string[],
+    frameCounts: Uint32Array,
+    frameLengths: Uint32Array,
+    opusFramesBuffer: Buffer
+  ) => IngestStatus[];
+  addPcmFrame: (
+    id: string,
+    samples: Int16Array,
+    sampleRate: number,
+    channels: number
+  ) => IngestStatus;
+  removeStream: (id: string) => boolean;
+  getStats: () => DetectorStats;
 }
@@ -0,0 +1,191 @@
+#include "GSpeechResponseParser.hpp"
+#include <cstdlib>
+
+CommandResult GSpeechResponseParser::Parse(const std::string& body) {
+  GSpeechResponseParser parser;
+  const bool parsed =
+      nlohmann::json::sax_parse(body.begin(), body.end(), &parser);
+
+  auto& result = parser.result;
+  if (!parsed) {
+    result.status = CommandStatus::Error;
+    result.error = "Invalid response: " + parser.error_message;
+  } else if (parser.has_error) {
+    result.status = CommandStatus::Error;
+    result.error = parser.error_message;
+  } else if (result.transcript.empty()) {
+    result.status = CommandStatus::Empty;
+  } else {
+    result.status = CommandStatus::Ok;
+  }
+
+  if (result.status != CommandStatus::Ok) {
+    result.transcript.clear();
+    result.words.clear();
+    result.confidence = -1;
+  }
+
+  return std::move(result);
+}
+
+bool GSpeechResponseParser::null() {
+  BeginValue();
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::boolean(bool value) {
+  BeginValue();
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::number_integer(int64_t value) {
+  BeginValue();
+  OnNumber(static_cast<double>(value));
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::number_unsigned(uint64_t value) {
+  BeginValue();
+  OnNumber(static_cast<double>(value));
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::number_float(double value,
+                                         const std::string& text) {
+  BeginValue();
+  OnNumber(value);
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::string(std::string& value) {
+  BeginValue();
+
+  if (IsAlternativeField(Transcript)) {
+    result.transcript = std::move(value);
+  } else if (IsWordField(Word)) {
+    result.words.back().word = std::move(value);
+  } else if (IsWordField(StartTime)) {
+    result.words.back().start_time = ParseDuration(value);
+  } else if (IsWordField(EndTime)) {
+    result.words.back().end_time = ParseDuration(value);
+  } else if (IsErrorField(Message)) {
+    error_message = std::move(value);
+  }
+
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::start_object(std::size_t elements) {
+  BeginValue();
+
+  // Every object in the words array of the alternative is a word
+  if (IsWordsElement()) {
+    result.words.emplace_back();
+  }
+  // The error object is present even if it has no message
+  if (path.size() == 1 && path[0] == Error) {
+    has_error = true;
+  }
+
+  containers.push_back({false, 0});
+  return true;
+}
+
+bool GSpeechResponseParser::key(std::string& value) {
+  path.push_back(GetKey(value));
+  return true;
+}
+
+bool GSpeechResponseParser::end_object() {
+  containers.pop_back();
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::start_array(std::size_t elements) {
+  BeginValue();
+  containers.push_back({true, 0});
+  return true;
+}
+
+bool GSpeechResponseParser::end_array() {
+  containers.pop_back();
+  EndValue();
+  return true;
+}
+
+bool GSpeechResponseParser::parse_error(std::size_t position,
+                                        const std::string& last_token,
+                                        const nlohmann::detail::exception& ex) {
+  error_message = ex.what();
+  return false;
+}
+
+GSpeechResponseParser::Key GSpeechResponseParser::GetKey(
+    const std::string& name) {
+  if (name == "results") return Results;
+  if (name == "alternatives") return Alternatives;
+  if (name == "transcript") return Transcript;
+  if (name == "confidence") return Confidence;
+  if (name == "words") return Words;
+  if (name == "word") return Word;
+  if (name == "startTime") return StartTime;
+  if (name == "endTime") return EndTime;
+  if (name == "error") return Error;
+  if (name == "message") return Message;
+  return Other;
+}
+
+void GSpeechResponseParser::BeginValue() {
+  // Array elements are identified by their index, object members already have
+  // their key in the path
+  if (!containers.empty() && containers.back().is_array) {
+    path.push_back(containers.back().next_index++);
+  }
+}
+
+void GSpeechResponseParser::EndValue() {
+  // Drop the index or the key of the finished value
+  if (!containers.empty()) {
+    path.pop_back();
+  }
+}
+
+bool GSpeechResponseParser::IsAlternativeField(Key field) const {
+  return path.size() == 5 && path[0] == Results && path[1] == 0 &&
+         path[2] == Alternatives && path[3] == 0 && path[4] == field;
+}
+
+bool GSpeechResponseParser::IsWordsElement() const {
+  return path.size() == 6 && path[0] == Results && path[1] == 0 &&
+         path[2] == Alternatives && path[3] == 0 && path[4] == Words &&
+         path[5] >= 0;
+}
+
+bool GSpeechResponseParser::IsWordField(Key field) const {
+  // The word entry is added when its object starts
+  return path.size() == 7 && path[0] == Results && path[1] == 0 &&
+         path[2] == Alternatives && path[3] == 0 && path[4] == Words &&
+         path[5] >= 0 && path[6] == field && !result.words.empty();
+}
+
+bool GSpeechResponseParser::IsErrorField(Key field) const {
+  return path.size() == 2 && path[0] == Error && path[1] == field;
+}
+
+void GSpeechResponseParser::OnNumber(double value) {
+  if (IsAlternativeField(Confidence)) {
+    result.confidence = value;
+  }
+}
+
+double GSpeechResponseParser::ParseDuration(const std::string& duration) {
+  // std::strtod stops at the unit suffix
+  return std::strtod(duration.c_str(), nullptr);
+}
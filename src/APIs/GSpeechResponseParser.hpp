@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstdint>
+#include <nlohmann/json.hpp>
+#include <string>
+#include <vector>
+#include "../types.h"
+
+// Extracts the command result from a GCloud Speech To Text response in a
+// single SAX pass, without building a JSON document
+// Only the first alternative of the first result is read: its transcript,
+// confidence and word offsets, along with the error message if there is one
+class GSpeechResponseParser {
+ public:
+  // Parses the response body
+  // Responses without speech get the Empty status, while invalid and error
+  // responses get the Error status
+  static CommandResult Parse(const std::string& body);
+
+  // SAX event handlers, invoked by nlohmann::json::sax_parse
+  bool null();
+  bool boolean(bool value);
+  bool number_integer(int64_t value);
+  bool number_unsigned(uint64_t value);
+  bool number_float(double value, const std::string& text);
+  bool string(std::string& value);
+  template <typename T>
+  bool binary(T& value) {
+    BeginValue();
+    EndValue();
+    return true;
+  }
+  bool start_object(std::size_t elements);
+  bool key(std::string& value);
+  bool end_object();
+  bool start_array(std::size_t elements);
+  bool end_array();
+  bool parse_error(std::size_t position, const std::string& last_token,
+                   const nlohmann::detail::exception& ex);
+
+ private:
+  // Keys that are part of the extracted paths
+  // Path segments store these as negative values and array indices as
+  // non-negative ones
+  enum Key : int64_t {
+    Other = -1,
+    Results = -2,
+    Alternatives = -3,
+    Transcript = -4,
+    Confidence = -5,
+    Words = -6,
+    Word = -7,
+    StartTime = -8,
+    EndTime = -9,
+    Error = -10,
+    Message = -11
+  };
+
+  // Open containers, with the index of the next element for arrays
+  struct Container {
+    bool is_array;
+    int64_t next_index;
+  };
+
+  std::vector<Container> containers;
+  // Path to the current value
+  std::vector<int64_t> path;
+
+  CommandResult result;
+  bool has_error = false;
+  std::string error_message;
+
+  GSpeechResponseParser() = default;
+
+  static Key GetKey(const std::string& name);
+
+  // Track the path for every value
+  void BeginValue();
+  void EndValue();
+
+  // Path matching
+  bool IsAlternativeField(Key field) const;
+  bool IsWordsElement() const;
+  bool IsWordField(Key field) const;
+  bool IsErrorField(Key field) const;
+
+  // Handles numeric values, Google sends confidence as a float
+  void OnNumber(double value);
+  // Word offsets are durations in the "1.300s" format
+  static double ParseDuration(const std::string& duration);
+};
@@ -4,31 +4,39 @@ GSpeechToText::GSpeechToText(std::string api_key) {
   this->api_key = std::move(api_key);
 }
 
-std::string GSpeechToText::GetTextFromOggOpus(
-    const std::vector<unsigned char>& audio_data) {
+void GSpeechToText::GetTextFromOggOpus(const EncodedAudio& audio,
+                                       HTTPClient::response_callback cb) {
   std::string api_url =
       "https://speech.googleapis.com/v1/speech:recognize?key=" + api_key;
-  std::string payload = GetOggAudioPayload(audio_data);
+  std::string payload = GetOggAudioPayload(audio);
 
-  return HTTPClient::PostJson(api_url, payload);
+  HTTPClient::PostJson(api_url, std::move(payload), std::move(cb));
 }
 
-std::string GSpeechToText::GetOggAudioPayload(
-    std::vector<unsigned char> audio_data) {
-  // Setup the payload
-  nlohmann::json payload;
-  payload["config"]["audioChannelCount"] = 1;
-  payload["config"]["encoding"] = "OGG_OPUS";
-  payload["config"]["model"] = "command_and_search";
-  payload["config"]["enableAutomaticPunctuation"] = false;
-  payload["config"]["sampleRateHertz"] = 16000;
-  payload["config"]["languageCode"] = "en-US";
-  payload["config"]["enableWordTimeOffsets"] = true;
+std::string GSpeechToText::GetOggAudioPayload(const EncodedAudio& audio) {
+  // Setup the config, which is small enough to go through the JSON library
+  nlohmann::json config;
+  config["audioChannelCount"] = audio.channels;
+  config["encoding"] = "OGG_OPUS";
+  config["model"] = "command_and_search";
+  config["enableAutomaticPunctuation"] = false;
+  config["sampleRateHertz"] = audio.sample_rate;
+  config["languageCode"] = "en-US";
+  config["enableWordTimeOffsets"] = true;
 
-  // B64 encode the audio data and add to the payload
-  std::string b64_audio = base64_encode(audio_data.data(), audio_data.size());
-  payload["audio"]["content"] = b64_audio;
+  // Write the audio straight into a pre-sized payload, since it's the bulk of
+  // the request
+  const std::string prefix =
+      "{\"config\":" + config.dump() + ",\"audio\":{\"content\":\"";
+  const std::string suffix = "\"}}";
+  const size_t content_length = Base64EncodedLength(audio.data.size());
 
-  // Return the stringified JSON
-  return payload.dump();
+  std::string payload;
+  payload.reserve(prefix.size() + content_length + suffix.size());
+  payload.append(prefix);
+  payload.resize(prefix.size() + content_length);
+  Base64Encode(audio.data.data(), audio.data.size(), &payload[prefix.size()]);
+  payload.append(suffix);
+
+  return payload;
 }
@@ -1,9 +1,10 @@
 #pragma once
 
-#include <base64.h>
 #include <nlohmann/json.hpp>
 #include <string>
 #include <vector>
+#include "../Utils/Base64.hpp"
+#include "../types.h"
 #include "HTTPClient.hpp"
 
 // Google Cloud Text To Speech API wrapper
@@ -11,11 +12,14 @@ class GSpeechToText {
  public:
   explicit GSpeechToText(std::string api_key);
   // Makes the GCloud API call to get the text of of speech
-  std::string GetTextFromOggOpus(const std::vector<unsigned char>& audio_data);
+  // The callback receives the JSON response from the I/O thread
+  void GetTextFromOggOpus(const EncodedAudio& audio,
+                          HTTPClient::response_callback cb);
 
  private:
   // API key to use
   std::string api_key;
   // Generates a JSON payload for querying the GCloud API
-  std::string GetOggAudioPayload(std::vector<unsigned char> audio_data);
+  // The audio is base64 encoded directly into the payload
+  std::string GetOggAudioPayload(const EncodedAudio& audio);
 };
@@ -1,77 +1,443 @@
 #include "HTTPClient.hpp"
 
-// Store local callbacks in an unnamed namespace
-namespace {
-// Data callback for the received data
-size_t WriteCallback(void *contents, size_t size, size_t nmemb,
-                     std::string *received_data) {
-  size_t new_length = size * nmemb;
+std::mutex HTTPClient::global_mt;
+std::thread HTTPClient::th;
+bool HTTPClient::run = false;
+int HTTPClient::connect_timeout_ms = 0;
+int HTTPClient::timeout_ms = 0;
+CURLM *HTTPClient::multi = nullptr;
+std::vector<std::unique_ptr<HTTPClient::Request>> HTTPClient::queued_requests;
+std::unordered_map<CURL *, std::unique_ptr<HTTPClient::Request>>
+    HTTPClient::active_requests;
+std::unordered_map<HTTPClient::stream_id, CURL *> HTTPClient::active_streams;
+std::vector<HTTPClient::stream_id> HTTPClient::resumed_streams;
+HTTPClient::stream_id HTTPClient::next_stream_id = 1;
+std::vector<CURL *> HTTPClient::idle_handles;
+CURLSH *HTTPClient::share = nullptr;
+std::array<std::mutex, CURL_LOCK_DATA_LAST> HTTPClient::share_mts;
 
-  received_data->append(reinterpret_cast<char *>(contents), new_length);
-  return new_length;
+// Upper limit for a single wait of the I/O thread
+constexpr int max_poll_timeout_ms = 1000;
+
+std::string HTTPResponse::Error() const {
+  if (code != CURLE_OK) {
+    return std::string("Request failed: ") + curl_easy_strerror(code);
+  }
+
+  return "Server responded with " + std::to_string(status);
 }
-}  // namespace
 
-std::string HTTPClient::PostJson(const std::string &uri,
-                                 const std::string &json_data) {
-  SPDLOG_INFO(
-      "HTTPClient::PostJson : Making a GCloud API request to parse the "
-      "speech.");
+void HTTPClient::Start(int connect_timeout_ms, int timeout_ms) {
+  std::lock_guard<std::mutex> lck(global_mt);
+
+  HTTPClient::connect_timeout_ms = connect_timeout_ms;
+  HTTPClient::timeout_ms = timeout_ms;
+
+  // Initialize the thread
+  if (!th.joinable()) {
+    multi = curl_multi_init();
+    // Requests to the same HTTP/2 host share a single connection
+    curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+    run = true;
+    th = std::thread(&HTTPClient::Worker);
+  }
+}
+
+void HTTPClient::Stop() {
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    run = false;
+    if (multi) {
+      curl_multi_wakeup(multi);
+    }
+  }
+
+  // Join without holding the lock, since the worker needs it to exit
+  if (th.joinable()) {
+    th.join();
+  }
 
-  SPDLOG_DEBUG("HTTPClient::PostJson : URI: {}, json_data size: {}", uri,
-               json_data.size());
+  // The worker is gone, so the requests can be finished from here
+  std::vector<std::unique_ptr<Request>> pending_requests;
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    pending_requests.swap(queued_requests);
+  }
+  for (auto &request : pending_requests) {
+    request->response.code = CURLE_ABORTED_BY_CALLBACK;
+    request->cb(request->response);
+  }
+  while (!active_requests.empty()) {
+    FinishRequest(active_requests.begin()->first, CURLE_ABORTED_BY_CALLBACK);
+  }
 
-  // Setup CURL handles
-  CURL *curl;
-  CURLcode res;
+  if (multi) {
+    curl_multi_cleanup(multi);
+    multi = nullptr;
+  }
+}
 
-  curl = curl_easy_init();
+void HTTPClient::PostJson(const std::string &uri, std::string json_data,
+                          response_callback cb) {
+  Post(uri, "application/json", std::move(json_data), std::move(cb));
+}
 
-  // Response data buffer
-  std::string received_data;
-  if (curl) {
-    // Setup CURL for an HTTPS POST request with JSON as body
-    curl_easy_setopt(curl, CURLOPT_USE_SSL, CURLUSESSL_TRY);
+void HTTPClient::Post(const std::string &uri, const std::string &content_type,
+                      std::string body, response_callback cb) {
+  SPDLOG_INFO("HTTPClient::Post : Queueing an API request to parse the speech.");
 
-    curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
+  SPDLOG_DEBUG("HTTPClient::Post : URI: {}, content type: {}, data size: {}",
+               uri, content_type, body.size());
 
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, json_data.c_str());
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, json_data.size());
+  auto request = std::make_unique<Request>();
+  request->uri = uri;
+  request->content_type = content_type;
+  request->body = std::move(body);
+  request->cb = std::move(cb);
+  Queue(std::move(request));
+}
 
-    struct curl_slist *headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+void HTTPClient::Post(const std::string &uri, const std::string &content_type,
+                      std::vector<unsigned char> &&body, response_callback cb) {
+  SPDLOG_INFO("HTTPClient::Post : Queueing an API request to parse the speech.");
 
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &received_data);
+  SPDLOG_DEBUG("HTTPClient::Post : URI: {}, content type: {}, data size: {}",
+               uri, content_type, body.size());
+
+  auto request = std::make_unique<Request>();
+  request->uri = uri;
+  request->content_type = content_type;
+  request->binary_body = std::move(body);
+  request->cb = std::move(cb);
+  Queue(std::move(request));
+}
+
+void HTTPClient::Queue(std::unique_ptr<Request> request) {
+  std::lock_guard<std::mutex> lck(global_mt);
+  queued_requests.push_back(std::move(request));
+
+  // Wake up the I/O thread to add the request
+  if (multi) {
+    curl_multi_wakeup(multi);
+  }
+}
 
-// Perform the request, unless in benchmark mode
-#ifndef DETECTOR_BENCHMARK
-    res = curl_easy_perform(curl);
-#endif
+HTTPClient::stream_id HTTPClient::PostStream(const std::string &uri,
+                                             const std::string &content_type,
+                                             read_callback read_cb,
+                                             data_callback data_cb,
+                                             response_callback cb) {
+  SPDLOG_DEBUG("HTTPClient::PostStream : URI: {}, content type: {}", uri,
+               content_type);
 
-    if (res != CURLE_OK) {
-      std::string error(curl_easy_strerror(res));
-      throw std::runtime_error("curl_easy_perform() failed: " + error);
+  auto request = std::make_unique<Request>();
+  request->uri = uri;
+  request->content_type = content_type;
+  request->cb = std::move(cb);
+  request->read_cb = std::move(read_cb);
+  request->data_cb = std::move(data_cb);
+
+  std::lock_guard<std::mutex> lck(global_mt);
+  const auto id = next_stream_id++;
+  request->id = id;
+  queued_requests.push_back(std::move(request));
+
+  if (multi) {
+    curl_multi_wakeup(multi);
+  }
+  return id;
+}
+
+void HTTPClient::ResumeStream(stream_id id) {
+  // Only the I/O thread can unpause the transfer
+  std::lock_guard<std::mutex> lck(global_mt);
+  resumed_streams.push_back(id);
+
+  if (multi) {
+    curl_multi_wakeup(multi);
+  }
+}
+
+void HTTPClient::Worker() {
+  std::vector<std::unique_ptr<Request>> new_requests;
+  std::vector<stream_id> new_resumed_streams;
+
+  while (true) {
+    {
+      std::lock_guard<std::mutex> lck(global_mt);
+      if (!run) {
+        break;
+      }
+      new_requests.swap(queued_requests);
+      new_resumed_streams.swap(resumed_streams);
     }
 
-    // Cleanup
-    delete headers;
-    curl_easy_cleanup(curl);
+    for (auto &request : new_requests) {
+      StartRequest(std::move(request));
+    }
+    new_requests.clear();
+
+    // Streams that finished or haven't started yet don't need resuming, the
+    // latter read their body once they start
+    for (auto id : new_resumed_streams) {
+      auto it = active_streams.find(id);
+      if (it != active_streams.end()) {
+        curl_easy_pause(it->second, CURLPAUSE_CONT);
+      }
+    }
+    new_resumed_streams.clear();
+
+    int running_handles = 0;
+    curl_multi_perform(multi, &running_handles);
+
+    // Complete the finished requests
+    CURLMsg *msg;
+    int msgs_left = 0;
+    while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+      if (msg->msg == CURLMSG_DONE) {
+        FinishRequest(msg->easy_handle, msg->data.result);
+      }
+    }
+
+    // Sleep until there is socket activity, a CURL timeout, a new request or
+    // the next stream deadline
+    const int poll_timeout_ms = ExpireStreams();
+    curl_multi_poll(multi, nullptr, 0, poll_timeout_ms, nullptr);
+  }
+}
+
+void HTTPClient::StartRequest(std::unique_ptr<Request> request) {
+  // Lease a CURL handle, which keeps its connection to the host open
+  CURL *curl = AcquireHandle();
+  if (!curl) {
+    request->response.code = CURLE_FAILED_INIT;
+    request->cb(request->response);
+    return;
+  }
+
+  // Setup CURL for an HTTPS POST request
+  curl_easy_setopt(curl, CURLOPT_URL, request->uri.c_str());
+  if (connect_timeout_ms > 0) {
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS,
+                     static_cast<long>(connect_timeout_ms));
+  }
+
+  const std::string content_type_header =
+      "Content-Type: " + request->content_type;
+  request->headers =
+      curl_slist_append(request->headers, content_type_header.c_str());
+
+  if (request->read_cb) {
+    // Send the body in chunks as it's produced, without waiting for a
+    // 100-continue response first
+    // HTTP/2 connections drop the chunked encoding header and use frames
+    // instead
+    request->headers =
+        curl_slist_append(request->headers, "Transfer-Encoding: chunked");
+    request->headers = curl_slist_append(request->headers, "Expect:");
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, StreamReadCallback);
+    curl_easy_setopt(curl, CURLOPT_READDATA, request.get());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, StreamWriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, request.get());
+    active_streams[request->id] = curl;
+  } else {
+    if (request->binary_body.empty()) {
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->body.data());
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, request->body.size());
+    } else {
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDS, request->binary_body.data());
+      curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE,
+                       request->binary_body.size());
+    }
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &request->response.body);
+
+    // A streamed request waits for its body as long as the command lasts, so
+    // it gets its own deadline instead
+    if (timeout_ms > 0) {
+      curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS,
+                       static_cast<long>(timeout_ms));
+    }
   }
+  curl_easy_setopt(curl, CURLOPT_HTTPHEADER, request->headers);
+
+  request->curl = curl;
+  curl_multi_add_handle(multi, curl);
+  active_requests[curl] = std::move(request);
+}
+
+void HTTPClient::FinishRequest(CURL *curl, CURLcode code) {
+  auto it = active_requests.find(curl);
+  if (it == active_requests.end()) {
+    return;
+  }
+
+  auto request = std::move(it->second);
+  active_requests.erase(it);
+  if (request->id) {
+    active_streams.erase(request->id);
+  }
+
+  request->response.code = code;
+  curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &request->response.status);
+
+  // Cleanup
+  curl_multi_remove_handle(multi, curl);
+  curl_slist_free_all(request->headers);
+  ReleaseHandle(curl);
 
   SPDLOG_INFO(
-      "HTTPClient::PostJson : Finished making a GCloud API request to parse "
+      "HTTPClient::FinishRequest : Finished making an API request to parse "
       "the speech.");
 
-  SPDLOG_DEBUG("HTTPClient::PostJson : Received data: {}.", received_data);
+  SPDLOG_DEBUG("HTTPClient::FinishRequest : Status: {}, received data: {}.",
+               request->response.status, request->response.body);
+
+  request->cb(request->response);
+}
+
+size_t HTTPClient::WriteCallback(char *data, size_t size, size_t nmemb,
+                                 void *userdata) {
+  size_t new_length = size * nmemb;
+
+  static_cast<std::string *>(userdata)->append(data, new_length);
+  return new_length;
+}
+
+int HTTPClient::ExpireStreams() {
+  const auto current_time = std::chrono::steady_clock::now();
+  auto poll_timeout = std::chrono::milliseconds(max_poll_timeout_ms);
+
+  std::vector<CURL *> expired;
+  for (const auto &entry : active_streams) {
+    const auto deadline = active_requests.at(entry.second)->deadline;
+    if (deadline <= current_time) {
+      expired.push_back(entry.second);
+    } else if (deadline - current_time < poll_timeout) {
+      // Rounded up, so that the poll doesn't wake up just before the deadline
+      poll_timeout =
+          std::chrono::duration_cast<std::chrono::milliseconds>(
+              deadline - current_time) +
+          std::chrono::milliseconds(1);
+    }
+  }
+
+  for (auto curl : expired) {
+    SPDLOG_WARN(
+        "HTTPClient::ExpireStreams : No response within {}ms after the end of "
+        "a streamed body.",
+        timeout_ms);
+    FinishRequest(curl, CURLE_OPERATION_TIMEDOUT);
+  }
+
+  return static_cast<int>(poll_timeout.count());
+}
 
-// Return a predetermined data in case of benchmark mode
-#ifdef DETECTOR_BENCHMARK
-  received_data =
-      "{\"results\":[{\"alternatives\": [{\"transcript\": \"TEST TEST TEST "
-      "TEST TEST TEST TEST TEST TEST TEST TEST TEST TEST TEST TEST TEST "
-      "TEST\"}]}]}";
-#endif
-  return received_data;
+size_t HTTPClient::StreamReadCallback(char *buffer, size_t size,
+                                     size_t nitems, void *userdata) {
+  auto *request = static_cast<Request *>(userdata);
+  const size_t length = request->read_cb(buffer, size * nitems);
+
+  // The timeout starts once the whole body has been read
+  if (length == 0 && timeout_ms > 0 &&
+      request->deadline == std::chrono::steady_clock::time_point::max()) {
+    request->deadline = std::chrono::steady_clock::now() +
+                        std::chrono::milliseconds(timeout_ms);
+  }
+  return length;
+}
+
+size_t HTTPClient::StreamWriteCallback(char *data, size_t size, size_t nmemb,
+                                       void *userdata) {
+  static_cast<Request *>(userdata)->data_cb(data, size * nmemb);
+  return size * nmemb;
+}
+
+void HTTPClient::LockShare(CURL *handle, curl_lock_data data,
+                           curl_lock_access access, void *userptr) {
+  share_mts[data].lock();
+}
+
+void HTTPClient::UnlockShare(CURL *handle, curl_lock_data data,
+                             void *userptr) {
+  share_mts[data].unlock();
+}
+
+CURLSH *HTTPClient::GetShare() {
+  if (share) {
+    return share;
+  }
+
+  share = curl_share_init();
+  if (!share) {
+    SPDLOG_WARN("HTTPClient::GetShare : curl_share_init() failed.");
+    return nullptr;
+  }
+
+  curl_share_setopt(share, CURLSHOPT_LOCKFUNC, LockShare);
+  curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, UnlockShare);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+
+  return share;
+}
+
+CURL *HTTPClient::AcquireHandle() {
+  CURL *curl = nullptr;
+  CURLSH *shared_data = nullptr;
+  {
+    std::lock_guard<std::mutex> lk(global_mt);
+    shared_data = GetShare();
+
+    if (!idle_handles.empty()) {
+      curl = idle_handles.back();
+      idle_handles.pop_back();
+    }
+  }
+
+  if (!curl) {
+    curl = curl_easy_init();
+    if (!curl) {
+      return nullptr;
+    }
+  }
+
+  // Reused handles are reset, so the settings are applied on every lease
+  if (shared_data) {
+    curl_easy_setopt(curl, CURLOPT_SHARE, shared_data);
+  }
+  curl_easy_setopt(curl, CURLOPT_USE_SSL, CURLUSESSL_TRY);
+  curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+  // Use HTTP/2 for HTTPS hosts, so that concurrent requests can share a single
+  // connection
+  curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+  curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+
+  return curl;
+}
+
+void HTTPClient::ReleaseHandle(CURL *curl) {
+  // Resetting keeps the connections and caches of the handle
+  curl_easy_reset(curl);
+
+  std::lock_guard<std::mutex> lk(global_mt);
+  idle_handles.push_back(curl);
+}
+
+void HTTPClient::Clear() {
+  std::lock_guard<std::mutex> lk(global_mt);
+
+  for (auto curl : idle_handles) {
+    curl_easy_cleanup(curl);
+  }
+  idle_handles.clear();
+
+  if (share) {
+    curl_share_cleanup(share);
+    share = nullptr;
+  }
 }
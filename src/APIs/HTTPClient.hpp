@@ -2,13 +2,164 @@
 
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
-#include "../Codecs/OpusOggEncoder.hpp"
 
-// A CURL wrapper to perform API calls with
+// Result of an HTTP request
+struct HTTPResponse {
+  // Transfer result
+  CURLcode code = CURLE_OK;
+  // HTTP status code, 0 if no response was received
+  long status = 0;
+  std::string body;
+
+  // Whether the request went through and the server accepted it
+  bool Ok() const { return code == CURLE_OK && status > 0 && status < 400; }
+  // Describes the failure
+  std::string Error() const;
+};
+
+// A static CURL wrapper to perform API calls with
+// Requests run on a single I/O thread that drives a curl_multi handle, so the
+// calling threads never wait for the network
+// Easy handles are pooled and share their DNS cache, TLS sessions and
+// connections, so that consecutive requests to the same host reuse an open
+// connection instead of doing a new handshake
 class HTTPClient {
  public:
-  static std::string PostJson(const std::string& uri,
-                              const std::string& json_data);
+  using response_callback = std::function<void(HTTPResponse&)>;
+  // Fills the buffer with the next part of a streamed body
+  using read_callback = std::function<size_t(char*, size_t)>;
+  // Receives a part of a streamed response body
+  using data_callback = std::function<void(const char*, size_t)>;
+  using stream_id = uint64_t;
+
+ private:
+  // Request that is queued or in progress
+  struct Request {
+    std::string uri;
+    std::string content_type;
+    std::string body;
+    // Binary body, sent instead of the text one when it's not empty
+    std::vector<unsigned char> binary_body;
+    response_callback cb;
+    CURL* curl = nullptr;
+    struct curl_slist* headers = nullptr;
+    HTTPResponse response;
+
+    // Set for the streamed requests, whose body is read and whose response
+    // is passed on as the transfer goes
+    stream_id id = 0;
+    read_callback read_cb;
+    data_callback data_cb;
+    // Time the streamed request fails at, set once its body ends
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+  };
+
+  // Lock
+  static std::mutex global_mt;
+  // I/O thread handle
+  static std::thread th;
+  // Start/stop toggle
+  static bool run;
+  // Timeouts of the connection and of the whole request, 0 disables them
+  // The timeout of a streamed request starts once its body ends
+  static int connect_timeout_ms;
+  static int timeout_ms;
+  // Multi handle that performs all the requests, owned by the I/O thread
+  static CURLM* multi;
+  // Requests waiting to be added to the multi handle
+  static std::vector<std::unique_ptr<Request>> queued_requests;
+  // Requests in progress, only accessed from the I/O thread
+  static std::unordered_map<CURL*, std::unique_ptr<Request>> active_requests;
+  // Streamed requests in progress, only accessed from the I/O thread
+  static std::unordered_map<stream_id, CURL*> active_streams;
+  // Paused streams that got more body data
+  static std::vector<stream_id> resumed_streams;
+  // Identifier for the next streamed request
+  static stream_id next_stream_id;
+
+  // Idle easy handles
+  static std::vector<CURL*> idle_handles;
+  // Data shared between all the handles
+  static CURLSH* share;
+  // Locks for every kind of the shared data
+  static std::array<std::mutex, CURL_LOCK_DATA_LAST> share_mts;
+
+  // The I/O thread worker
+  static void Worker();
+  // Queues a request for the I/O thread
+  static void Queue(std::unique_ptr<Request> request);
+  // Adds a queued request to the multi handle
+  static void StartRequest(std::unique_ptr<Request> request);
+  // Removes a finished request and invokes its callback
+  static void FinishRequest(CURL* curl, CURLcode code);
+  // Fails the streamed requests past their deadline
+  // Returns the time until the next deadline, capped at the max poll timeout
+  static int ExpireStreams();
+
+  // CURL callbacks
+  static size_t WriteCallback(char* data, size_t size, size_t nmemb,
+                              void* userdata);
+  static size_t StreamReadCallback(char* buffer, size_t size, size_t nitems,
+                                   void* userdata);
+  static size_t StreamWriteCallback(char* data, size_t size, size_t nmemb,
+                                    void* userdata);
+  static void LockShare(CURL* handle, curl_lock_data data,
+                        curl_lock_access access, void* userptr);
+  static void UnlockShare(CURL* handle, curl_lock_data data, void* userptr);
+
+  // Creates the share handle on first use
+  // Only called with the lock acquired
+  static CURLSH* GetShare();
+
+ public:
+  // Start the I/O thread with the specified timeouts, 0 disables them
+  static void Start(int connect_timeout_ms, int timeout_ms);
+  // Stop the I/O thread
+  // Requests that didn't finish are completed with CURLE_ABORTED_BY_CALLBACK
+  static void Stop();
+
+  // Posts a JSON body
+  static void PostJson(const std::string& uri, std::string json_data,
+                       response_callback cb);
+  // Posts a body of the specified content type
+  // The callback is invoked from the I/O thread once the response arrives
+  static void Post(const std::string& uri, const std::string& content_type,
+                   std::string body, response_callback cb);
+  // Posts a binary body, which is moved into the request instead of copied
+  static void Post(const std::string& uri, const std::string& content_type,
+                   std::vector<unsigned char>&& body, response_callback cb);
+
+  // Posts a body that is produced while the request is in progress, in chunks
+  // The read callback fills the buffer with the next part of the body and
+  // returns its length, 0 to end the body or CURL_READFUNC_PAUSE to pause the
+  // upload until ResumeStream is called
+  // The data callback receives the response body as it arrives, and the
+  // response callback the status once the request is done
+  // All the callbacks are invoked from the I/O thread and released afterwards
+  static stream_id PostStream(const std::string& uri,
+                              const std::string& content_type,
+                              read_callback read_cb, data_callback data_cb,
+                              response_callback cb);
+  // Resumes the upload of a paused stream, can be called from any thread
+  static void ResumeStream(stream_id id);
+
+  // Leases an idle easy handle, or creates a new one if there are none
+  // The handle comes with the shared data and connection settings applied
+  // Returns nullptr if CURL fails to create a handle
+  static CURL* AcquireHandle();
+  // Returns a handle to the pool, its options are reset
+  static void ReleaseHandle(CURL* curl);
+  // Deletes all idle handles and the shared data
+  static void Clear();
 };
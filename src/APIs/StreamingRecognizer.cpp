@@ -0,0 +1,177 @@
+#include "StreamingRecognizer.hpp"
+
+StreamingRecognizer::StreamingRecognizer(std::string url, int sample_rate,
+                                         int channels, result_callback cb)
+    : sample_rate(sample_rate), channels(channels) {
+  this->url = std::move(url);
+  this->cb = std::move(cb);
+}
+
+std::shared_ptr<StreamingRecognizer> StreamingRecognizer::Create(
+    std::string url, int sample_rate, int channels, result_callback cb) {
+  auto recognizer = std::make_shared<StreamingRecognizer>(
+      std::move(url), sample_rate, channels, std::move(cb));
+  recognizer->Start();
+  return recognizer;
+}
+
+void StreamingRecognizer::Write(const PCMChunkPool::chunk& frames) {
+  if (frames->Empty()) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> lk(mt);
+  pending_chunks.push_back(frames);
+  Resume(lk);
+}
+
+void StreamingRecognizer::Finish() {
+  std::unique_lock<std::mutex> lk(mt);
+  finished = true;
+  Resume(lk);
+}
+
+void StreamingRecognizer::Start() {
+  SPDLOG_INFO("StreamingRecognizer::Start : Starting a transfer to {}.", url);
+
+  const std::string content_type = "audio/l16; rate=" +
+                                   std::to_string(sample_rate) +
+                                   "; channels=" + std::to_string(channels);
+
+  // The callbacks keep the instance alive until the transfer is done
+  auto self = shared_from_this();
+  stream_id = HTTPClient::PostStream(
+      url, content_type,
+      [self](char* buffer, size_t size) {
+        return self->ReadAudio(buffer, size);
+      },
+      [self](const char* data, size_t size) {
+        self->ReceiveResponse(data, size);
+      },
+      [self](HTTPResponse& response) { self->Complete(response); });
+}
+
+void StreamingRecognizer::Resume(std::unique_lock<std::mutex>& lk) {
+  if (!paused) {
+    return;
+  }
+
+  // The read callback pauses again if the audio runs out before it's sent
+  paused = false;
+  lk.unlock();
+  HTTPClient::ResumeStream(stream_id);
+}
+
+size_t StreamingRecognizer::ReadAudio(char* buffer, size_t size) {
+  std::lock_guard<std::mutex> lk(mt);
+
+  if (pending_chunks.empty() && !finished) {
+    // Write resumes the upload, meanwhile the responses keep being read, so
+    // the interim results arrive as soon as the server sends them
+    paused = true;
+    return CURL_READFUNC_PAUSE;
+  }
+
+  // Returning 0 ends the request body
+  size_t length = 0;
+  while (length < size && !pending_chunks.empty()) {
+    const auto& chunk = pending_chunks.front();
+    const auto* bytes = reinterpret_cast<const char*>(chunk->Data());
+    const size_t chunk_length = chunk->Size() * sizeof(pcm_frame);
+
+    const size_t copied =
+        std::min(size - length, chunk_length - pending_offset);
+    std::copy_n(bytes + pending_offset, copied, buffer + length);
+    length += copied;
+    pending_offset += copied;
+
+    // Release the chunk once it's sent
+    if (pending_offset == chunk_length) {
+      pending_chunks.pop_front();
+      pending_offset = 0;
+    }
+  }
+
+  return length;
+}
+
+void StreamingRecognizer::Complete(HTTPResponse& response) {
+  if (!response.Ok()) {
+    SPDLOG_ERROR("StreamingRecognizer::Complete : {}", response.Error());
+  }
+
+  // The last line doesn't need a trailing newline
+  if (!response_line.empty()) {
+    HandleResponseLine(response_line);
+    response_line.clear();
+  }
+
+  // The command always gets a final result, the last interim one is used if
+  // the server didn't send one
+  if (!final_delivered) {
+    CommandResult result = last_result;
+    result.is_final = true;
+    if (!response.Ok()) {
+      result.status = CommandStatus::Error;
+      result.error = response.Error();
+    }
+    Deliver(result);
+  }
+
+  SPDLOG_INFO("StreamingRecognizer::Complete : Finished the transfer.");
+}
+
+void StreamingRecognizer::ReceiveResponse(const char* data, size_t size) {
+  response_line.append(data, size);
+
+  // Handle every complete line and keep the partial one
+  size_t line_start = 0;
+  size_t line_end;
+  while ((line_end = response_line.find('\n', line_start)) !=
+         std::string::npos) {
+    HandleResponseLine(response_line.substr(line_start, line_end - line_start));
+    line_start = line_end + 1;
+  }
+  response_line.erase(0, line_start);
+}
+
+void StreamingRecognizer::HandleResponseLine(const std::string& line) {
+  if (final_delivered || line.find_first_not_of(" \t\r") == std::string::npos) {
+    return;
+  }
+
+  auto parsed_data = nlohmann::json::parse(line, nullptr, false);
+  if (parsed_data.is_discarded() || !parsed_data.is_object() ||
+      !parsed_data["transcript"].is_string()) {
+    SPDLOG_WARN("StreamingRecognizer::HandleResponseLine : Invalid result: {}",
+                line);
+    return;
+  }
+
+  CommandResult result;
+  result.transcript = parsed_data["transcript"];
+  result.is_final = parsed_data["is_final"].is_boolean() &&
+                    parsed_data["is_final"].get<bool>();
+  if (parsed_data["confidence"].is_number()) {
+    result.confidence = parsed_data["confidence"];
+  }
+
+  SPDLOG_DEBUG(
+      "StreamingRecognizer::HandleResponseLine : Result: {}, is_final: {}.",
+      result.transcript, result.is_final);
+
+  last_result = result;
+  Deliver(result);
+}
+
+void StreamingRecognizer::Deliver(CommandResult& result) {
+  if (!result.is_final) {
+    cb(result);
+    return;
+  }
+
+  // Release the callback, since it keeps the command alive
+  final_delivered = true;
+  auto callback = std::move(cb);
+  callback(result);
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <curl/curl.h>
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <nlohmann/json.hpp>
+#include <string>
+#include "../Buffers/PCMChunkPool.hpp"
+#include "../types.h"
+#include "HTTPClient.hpp"
+
+// Streams command audio to a recognition server while it's being spoken
+// The audio is sent as the body of a single chunked POST request in raw 16-bit
+// little endian PCM, and the server responds with newline delimited JSON
+// objects: {"transcript": string, "is_final": bool, "confidence": number}, where
+// the confidence is optional
+// The transfers are driven by the HTTPClient I/O thread, which pauses the upload
+// while no audio is pending, and reuse its connections across the commands
+class StreamingRecognizer
+    : public std::enable_shared_from_this<StreamingRecognizer> {
+ public:
+  using result_callback = std::function<void(CommandResult&)>;
+
+  // Use Create() instead, which also starts the transfer
+  StreamingRecognizer(std::string url, int sample_rate, int channels,
+                      result_callback cb);
+  StreamingRecognizer(const StreamingRecognizer&) = delete;
+  StreamingRecognizer(const StreamingRecognizer&&) = delete;
+
+  // Creates a new instance and starts the transfer
+  // The callback receives the interim results and exactly one final result,
+  // after which it's released
+  static std::shared_ptr<StreamingRecognizer> Create(std::string url,
+                                                     int sample_rate,
+                                                     int channels,
+                                                     result_callback cb);
+
+  // Queues audio for the upload
+  // The chunk is referenced until it's sent, instead of being copied
+  void Write(const PCMChunkPool::chunk& frames);
+
+  // Ends the upload, the final result follows once the server responds
+  void Finish();
+
+ private:
+  // Server settings
+  std::string url;
+  int sample_rate;
+  int channels;
+
+  // Result callback, only invoked from the I/O thread
+  result_callback cb;
+
+  // Transfer of the audio
+  HTTPClient::stream_id stream_id = 0;
+
+  // Lock for the upload state
+  std::mutex mt;
+  // Audio waiting for the upload, and the amount of bytes of the first chunk
+  // that were already sent
+  std::deque<PCMChunkPool::chunk> pending_chunks;
+  size_t pending_offset = 0;
+  // Set once all the audio has been queued
+  bool finished = false;
+  // Set while the upload is paused for the lack of audio
+  bool paused = false;
+
+  // Response state, only accessed from the I/O thread
+  std::string response_line;
+  CommandResult last_result;
+  bool final_delivered = false;
+
+  // Starts the transfer
+  void Start();
+  // Resumes the upload if it's paused
+  void Resume(std::unique_lock<std::mutex>& lk);
+
+  // Copies pending audio into the request body, pauses the upload if there is
+  // none
+  size_t ReadAudio(char* buffer, size_t size);
+  // Handles the end of the transfer
+  void Complete(HTTPResponse& response);
+  // Splits the response into lines
+  void ReceiveResponse(const char* data, size_t size);
+  // Parses a single result
+  void HandleResponseLine(const std::string& line);
+  // Invokes the callback, releasing it after the final result
+  void Deliver(CommandResult& result);
+};
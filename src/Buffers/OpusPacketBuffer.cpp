@@ -0,0 +1,44 @@
+#include "OpusPacketBuffer.hpp"
+
+void OpusPacketBuffer::Add(const opus_byte* data, size_t length) {
+  slab.insert(slab.end(), data, data + length);
+  packet_ends.push_back(slab.size());
+}
+
+void OpusPacketBuffer::Append(const OpusPacketBuffer& other, size_t first) {
+  if (first >= other.Size()) {
+    return;
+  }
+
+  const size_t first_offset = other.PacketOffset(first);
+  const size_t offset = slab.size();
+  slab.insert(slab.end(), other.slab.begin() + first_offset, other.slab.end());
+  for (size_t i = first; i < other.packet_ends.size(); i++) {
+    packet_ends.push_back(offset + other.packet_ends[i] - first_offset);
+  }
+}
+
+void OpusPacketBuffer::DropFront(size_t count) {
+  if (count >= Size()) {
+    Clear();
+    return;
+  }
+  if (count == 0) {
+    return;
+  }
+
+  // Moves the remaining packets to the front, which is fine for the rare
+  // backlog shedding
+  const size_t dropped_bytes = packet_ends[count - 1];
+  slab.erase(slab.begin(), slab.begin() + dropped_bytes);
+  packet_ends.erase(packet_ends.begin(), packet_ends.begin() + count);
+  for (auto& end : packet_ends) {
+    end -= dropped_bytes;
+  }
+}
+
+void OpusPacketBuffer::Clear() {
+  // clear() doesn't release the capacity, so the storage gets recycled
+  slab.clear();
+  packet_ends.clear();
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "../types.h"
+
+// Stores OPUS packets back to back in a single contiguous byte slab with a
+// separate length index
+// Clearing keeps the allocated capacity, so a buffer that gets reused doesn't
+// allocate once it has grown to the stream's usual batch size
+class OpusPacketBuffer {
+ public:
+  // Appends a packet to the buffer
+  void Add(const opus_byte* data, size_t length);
+
+  // Appends the packets of another buffer, starting with the specified one
+  void Append(const OpusPacketBuffer& other, size_t first = 0);
+
+  // Removes the specified amount of packets from the front
+  void DropFront(size_t count);
+
+  // Removes all packets while keeping the allocated storage
+  void Clear();
+
+  // Amount of stored packets
+  size_t Size() const { return packet_ends.size(); }
+  bool Empty() const { return packet_ends.empty(); }
+
+  // Packet accessors
+  const opus_byte* PacketData(size_t index) const {
+    return slab.data() + PacketOffset(index);
+  }
+  size_t PacketLength(size_t index) const {
+    return packet_ends[index] - PacketOffset(index);
+  }
+
+ private:
+  // Packet data
+  std::vector<opus_byte> slab;
+  // End offset of every packet in the slab
+  std::vector<size_t> packet_ends;
+
+  size_t PacketOffset(size_t index) const {
+    return index == 0 ? 0 : packet_ends[index - 1];
+  }
+};
@@ -0,0 +1,56 @@
+#include "PCMChunkPool.hpp"
+
+// Limits of the idle pool, so that a burst doesn't pin its memory
+constexpr size_t max_idle_chunks = 1024;
+// About 4 seconds of 16kHz audio
+constexpr size_t max_idle_chunk_capacity = 65536;
+
+std::mutex PCMChunkPool::global_mt;
+std::vector<PCMChunk*> PCMChunkPool::idle_chunks;
+
+void PCMChunkPool::Release(PCMChunk* released_chunk) {
+  released_chunk->frames.clear();
+
+  if (released_chunk->frames.capacity() <= max_idle_chunk_capacity) {
+    std::lock_guard<std::mutex> lck(global_mt);
+    if (idle_chunks.size() < max_idle_chunks) {
+      idle_chunks.push_back(released_chunk);
+      return;
+    }
+  }
+
+  delete released_chunk;
+}
+
+PCMChunkPool::mutable_chunk PCMChunkPool::Acquire() {
+  PCMChunk* acquired_chunk = nullptr;
+
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    if (!idle_chunks.empty()) {
+      acquired_chunk = idle_chunks.back();
+      idle_chunks.pop_back();
+    }
+  }
+
+  if (acquired_chunk == nullptr) {
+    acquired_chunk = new PCMChunk();
+  }
+
+  return mutable_chunk(acquired_chunk, &PCMChunkPool::Release);
+}
+
+PCMChunkPool::mutable_chunk PCMChunkPool::Acquire(
+    std::vector<pcm_frame>& frames) {
+  auto acquired_chunk = Acquire();
+  std::swap(acquired_chunk->frames, frames);
+  return acquired_chunk;
+}
+
+void PCMChunkPool::Clear() {
+  std::lock_guard<std::mutex> lck(global_mt);
+  for (auto idle_chunk : idle_chunks) {
+    delete idle_chunk;
+  }
+  idle_chunks.clear();
+}
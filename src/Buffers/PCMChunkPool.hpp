@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "../types.h"
+
+// Block of PCM samples
+// Filled once by its producer and then shared read only, so that the hotword
+// queue and the command segments reference the same audio instead of copying
+// it
+class PCMChunk {
+ public:
+  std::vector<pcm_frame> frames;
+
+  const pcm_frame* Data() const { return frames.data(); }
+  size_t Size() const { return frames.size(); }
+  bool Empty() const { return frames.empty(); }
+};
+
+// A static class that recycles the storage of the released PCM chunks, so
+// that the steady state audio processing doesn't allocate sample buffers
+class PCMChunkPool {
+ public:
+  // Chunk that is still being filled
+  using mutable_chunk = std::shared_ptr<PCMChunk>;
+  // Filled chunk, returned to the pool once the last reference is gone
+  using chunk = std::shared_ptr<const PCMChunk>;
+
+ private:
+  // Lock
+  static std::mutex global_mt;
+  // Released chunks, with their storage kept
+  static std::vector<PCMChunk*> idle_chunks;
+
+  // Returns a chunk to the idle pool, or frees it if the pool is full
+  static void Release(PCMChunk* released_chunk);
+
+ public:
+  // Leases an empty chunk, reusing the storage of a released one if possible
+  static mutable_chunk Acquire();
+  // Leases a chunk that takes over the specified samples without copying
+  // The vector receives the chunk's previous storage in exchange
+  static mutable_chunk Acquire(std::vector<pcm_frame>& frames);
+  // Deletes all idle chunks
+  static void Clear();
+};
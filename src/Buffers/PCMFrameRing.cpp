@@ -0,0 +1,61 @@
+#include "PCMFrameRing.hpp"
+#include <algorithm>
+#include <cstring>
+
+PCMFrameRing::PCMFrameRing(size_t frame_length, size_t capacity)
+    : frame_length(frame_length), slot_count(capacity + 1) {
+  storage.resize(slot_count * frame_length);
+}
+
+size_t PCMFrameRing::Write(const pcm_frame* data, size_t size) {
+  size_t overwritten = 0;
+
+  while (size > 0) {
+    pcm_frame* partial = &storage[PartialSlot() * frame_length];
+    const size_t count = std::min(size, frame_length - partial_length);
+    std::memcpy(partial + partial_length, data, count * sizeof(pcm_frame));
+
+    data += count;
+    size -= count;
+    partial_length += count;
+
+    if (partial_length < frame_length) {
+      break;
+    }
+
+    // The partial frame is complete, so the next slot becomes the partial one
+    // If that's the oldest complete frame, overwrite it
+    partial_length = 0;
+    if (frame_count + 1 == slot_count) {
+      read_slot = (read_slot + 1) % slot_count;
+      overwritten++;
+    } else {
+      frame_count++;
+    }
+  }
+
+  return overwritten;
+}
+
+const pcm_frame* PCMFrameRing::Front() const {
+  return &storage[read_slot * frame_length];
+}
+
+void PCMFrameRing::Pop() {
+  read_slot = (read_slot + 1) % slot_count;
+  frame_count--;
+}
+
+void PCMFrameRing::DrainInto(std::vector<pcm_frame>& out) {
+  out.reserve(out.size() + frame_count * frame_length + partial_length);
+
+  for (; frame_count > 0; Pop()) {
+    out.insert(out.end(), Front(), Front() + frame_length);
+  }
+
+  const pcm_frame* partial = &storage[PartialSlot() * frame_length];
+  out.insert(out.end(), partial, partial + partial_length);
+
+  read_slot = 0;
+  partial_length = 0;
+}
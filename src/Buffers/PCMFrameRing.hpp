@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include "../types.h"
+
+// Fixed capacity circular PCM buffer made of equally sized frames
+// Every complete frame is stored contiguously, so it can be processed in place
+// When full, the oldest complete frames are overwritten
+class PCMFrameRing {
+ public:
+  // Capacity is the amount of complete frames that can be held
+  PCMFrameRing(size_t frame_length, size_t capacity);
+
+  // Appends samples, returns the amount of overwritten complete frames
+  size_t Write(const pcm_frame* data, size_t size);
+
+  // Amount of complete frames
+  size_t Size() const { return frame_count; }
+  bool Empty() const { return frame_count == 0; }
+
+  // Oldest complete frame, valid until the next Write or Pop
+  const pcm_frame* Front() const;
+  // Removes the oldest complete frame
+  void Pop();
+
+  // Moves all the complete frames and the partial one to the end of the
+  // vector and clears the buffer
+  void DrainInto(std::vector<pcm_frame>& out);
+
+ private:
+  size_t frame_length;
+  // One slot more than the capacity, for the partially written frame
+  size_t slot_count;
+  std::vector<pcm_frame> storage;
+
+  // Slot of the oldest complete frame
+  size_t read_slot = 0;
+  // Amount of complete frames
+  size_t frame_count = 0;
+  // Samples written to the partial frame, which follows the complete ones
+  size_t partial_length = 0;
+
+  size_t PartialSlot() const { return (read_slot + frame_count) % slot_count; }
+};
@@ -0,0 +1,102 @@
+#include "SpscPacketRing.hpp"
+#include <cstring>
+
+constexpr size_t SpscPacketRing::max_packet_length;
+constexpr size_t SpscPacketRing::min_capacity;
+
+// Unnamed namespace for local utilities
+namespace {
+using record_header = uint32_t;
+
+// Marks the unused space at the end of the ring when a packet didn't fit
+constexpr record_header wrap_marker = UINT32_MAX;
+constexpr size_t header_size = sizeof(record_header);
+
+size_t AlignToHeader(size_t size) {
+  return (size + header_size - 1) & ~(header_size - 1);
+}
+
+size_t NextPowerOfTwo(size_t value) {
+  // Values above the highest power of two are rounded down to it
+  size_t result = header_size;
+  while (result < value && (result << 1) != 0) {
+    result <<= 1;
+  }
+  return result;
+}
+}  // namespace
+
+SpscPacketRing::SpscPacketRing(size_t capacity)
+    : capacity(NextPowerOfTwo(capacity)) {
+  mask = this->capacity - 1;
+  storage.resize(this->capacity);
+}
+
+bool SpscPacketRing::TryPush(const opus_byte* data, size_t length) {
+  const size_t record_size = header_size + AlignToHeader(length);
+  if (length >= wrap_marker || record_size > capacity) {
+    return false;
+  }
+
+  size_t current_tail = tail.load(std::memory_order_relaxed);
+  const size_t position = current_tail & mask;
+
+  // Records are never split, so a record that doesn't fit before the end of
+  // the ring also consumes the remaining space
+  const size_t contiguous = capacity - position;
+  const size_t padding = record_size > contiguous ? contiguous : 0;
+  const size_t required = padding + record_size;
+
+  if (required > capacity - (current_tail - cached_head)) {
+    cached_head = head.load(std::memory_order_acquire);
+    if (required > capacity - (current_tail - cached_head)) {
+      return false;
+    }
+  }
+
+  if (padding > 0) {
+    // Positions are header aligned, so the marker always fits
+    std::memcpy(&storage[position], &wrap_marker, header_size);
+    current_tail += padding;
+  }
+
+  const auto header = static_cast<record_header>(length);
+  opus_byte* record = &storage[current_tail & mask];
+  std::memcpy(record, &header, header_size);
+  std::memcpy(record + header_size, data, length);
+
+  // Publish the record to the consumer
+  tail.store(current_tail + record_size, std::memory_order_release);
+  return true;
+}
+
+size_t SpscPacketRing::DrainInto(OpusPacketBuffer& out) {
+  size_t current_head = head.load(std::memory_order_relaxed);
+  const size_t current_tail = tail.load(std::memory_order_acquire);
+  size_t count = 0;
+
+  while (current_head != current_tail) {
+    const size_t position = current_head & mask;
+
+    record_header header;
+    std::memcpy(&header, &storage[position], header_size);
+
+    if (header == wrap_marker) {
+      current_head += capacity - position;
+      continue;
+    }
+
+    out.Add(&storage[position + header_size], header);
+    current_head += header_size + AlignToHeader(header);
+    count++;
+  }
+
+  // Release the space back to the producer
+  head.store(current_head, std::memory_order_release);
+  return count;
+}
+
+bool SpscPacketRing::Empty() const {
+  return head.load(std::memory_order_acquire) ==
+         tail.load(std::memory_order_acquire);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../types.h"
+#include "OpusPacketBuffer.hpp"
+
+// Bounded lock-free single producer/single consumer queue of variable sized
+// packets
+// Packets are stored in a byte ring as a 4 byte length header followed by the
+// payload, both padded to 4 byte boundaries
+// Only one thread may push and only one thread at a time may drain
+class SpscPacketRing {
+ public:
+  // Largest OPUS packet, 3 frames of 1275 bytes with the code 3 framing
+  static constexpr size_t max_packet_length = 3 * 1275 + 7;
+  // Smallest capacity that fits a packet of the max length at any position,
+  // i.e. two of its records, since one can be preceded by the wrap padding
+  static constexpr size_t min_capacity =
+      2 * (sizeof(uint32_t) + ((max_packet_length + 3) & ~size_t(3)));
+
+  // The capacity is rounded up to the next power of two
+  explicit SpscPacketRing(size_t capacity);
+  SpscPacketRing(const SpscPacketRing&) = delete;
+  SpscPacketRing(const SpscPacketRing&&) = delete;
+
+  // Producer: copies the packet into the ring
+  // Returns false without blocking if there is not enough free space
+  bool TryPush(const opus_byte* data, size_t length);
+
+  // Consumer: moves all the available packets into the buffer in FIFO order
+  // Returns the amount of moved packets
+  size_t DrainInto(OpusPacketBuffer& out);
+
+  // Whether there are no packets available to the consumer
+  bool Empty() const;
+
+ private:
+  // Packet data
+  std::vector<opus_byte> storage;
+  size_t capacity;
+  size_t mask;
+
+  // Consumer position, written by the consumer only
+  alignas(64) std::atomic<size_t> head{0};
+  // Producer position, written by the producer only
+  alignas(64) std::atomic<size_t> tail{0};
+  // Producer's last seen consumer position, to avoid touching the consumer's
+  // cache line on every push
+  alignas(64) size_t cached_head = 0;
+};
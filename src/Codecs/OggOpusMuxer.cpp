@@ -0,0 +1,173 @@
+#include "OggOpusMuxer.hpp"
+#include <array>
+#include <cstring>
+#include <string>
+
+// Unnamed namespace for local utilities
+namespace {
+// OPUS granule positions are always in 48kHz samples
+constexpr int granule_rate = 48000;
+// Ogg limits
+constexpr size_t max_page_segments = 255;
+constexpr size_t max_segment_size = 255;
+// Pages are flushed once they reach this size to keep them reasonably small
+constexpr size_t target_page_size = 4096;
+// Ogg page header flags
+constexpr uint8_t page_flag_bos = 0x02;
+constexpr uint8_t page_flag_eos = 0x04;
+// Bitstream serial number, there is a single stream
+constexpr uint32_t stream_serial = 0x4F505553;
+// Vendor string of the OpusTags header
+constexpr char vendor[] = "native-voice-command-detector";
+
+// CRC-32 used by Ogg: polynomial 0x04C11DB7, no reflection, no final XOR
+uint32_t OggCRC(const unsigned char* data, size_t size, uint32_t crc) {
+  static const std::array<uint32_t, 256> table = []() {
+    std::array<uint32_t, 256> result{};
+    for (uint32_t i = 0; i < result.size(); i++) {
+      uint32_t value = i << 24;
+      for (int bit = 0; bit < 8; bit++) {
+        value = (value & 0x80000000) ? (value << 1) ^ 0x04C11DB7 : value << 1;
+      }
+      result[i] = value;
+    }
+    return result;
+  }();
+
+  for (size_t i = 0; i < size; i++) {
+    crc = (crc << 8) ^ table[((crc >> 24) ^ data[i]) & 0xFF];
+  }
+  return crc;
+}
+
+void PutLE(std::vector<unsigned char>& out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) {
+    out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+  }
+}
+
+// Collects packets into Ogg pages and appends the finished pages to a buffer
+class OggPageWriter {
+ public:
+  explicit OggPageWriter(std::vector<unsigned char>& out) : out(out) {}
+
+  void AddPacket(const unsigned char* data, size_t size, int64_t granule) {
+    const size_t segment_count = size / max_segment_size + 1;
+    if (segments.size() + segment_count > max_page_segments) {
+      Flush(0);
+    }
+
+    // Lacing values, a packet always ends with a segment shorter than 255
+    for (size_t i = 0; i < segment_count - 1; i++) {
+      segments.push_back(max_segment_size);
+    }
+    segments.push_back(static_cast<unsigned char>(size % max_segment_size));
+    body.insert(body.end(), data, data + size);
+    granule_position = granule;
+
+    if (body.size() >= target_page_size) {
+      Flush(0);
+    }
+  }
+
+  void Flush(uint8_t flags) {
+    if (segments.empty() && !(flags & page_flag_eos)) {
+      return;
+    }
+
+    const size_t page_start = out.size();
+    out.insert(out.end(), {'O', 'g', 'g', 'S', 0});
+    out.push_back(flags | (page_sequence == 0 ? page_flag_bos : 0));
+    PutLE(out, static_cast<uint64_t>(granule_position), 8);
+    PutLE(out, stream_serial, 4);
+    PutLE(out, page_sequence++, 4);
+    // CRC placeholder, computed over the whole page with this field zeroed
+    const size_t crc_offset = out.size();
+    PutLE(out, 0, 4);
+    out.push_back(static_cast<unsigned char>(segments.size()));
+    out.insert(out.end(), segments.begin(), segments.end());
+    out.insert(out.end(), body.begin(), body.end());
+
+    const uint32_t crc = OggCRC(&out[page_start], out.size() - page_start, 0);
+    for (int i = 0; i < 4; i++) {
+      out[crc_offset + i] = static_cast<unsigned char>(crc >> (8 * i));
+    }
+
+    segments.clear();
+    body.clear();
+  }
+
+ private:
+  std::vector<unsigned char>& out;
+  std::vector<unsigned char> segments;
+  std::vector<unsigned char> body;
+  int64_t granule_position = 0;
+  uint32_t page_sequence = 0;
+};
+
+// Channel count from the TOC byte
+int GetChannelCount(const opus_byte* packet) {
+  return opus_packet_get_nb_channels(packet);
+}
+}  // namespace
+
+bool OggOpusMuxer::CanMux(const OpusPacketBuffer& packets) {
+  if (packets.Empty()) {
+    return false;
+  }
+
+  const int channels = GetChannelCount(packets.PacketData(0));
+  for (size_t i = 0; i < packets.Size(); i++) {
+    const opus_byte* packet = packets.PacketData(i);
+    const size_t size = packets.PacketLength(i);
+
+    if (size == 0 || GetChannelCount(packet) != channels ||
+        opus_packet_get_nb_samples(packet, size, granule_rate) <= 0) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+EncodedAudio OggOpusMuxer::Mux(const OpusPacketBuffer& packets) {
+  EncodedAudio audio;
+  audio.sample_rate = granule_rate;
+  audio.channels = GetChannelCount(packets.PacketData(0));
+
+  OggPageWriter writer(audio.data);
+
+  // Identification header, each header has a page of its own
+  std::vector<unsigned char> header = {'O', 'p', 'u', 's', 'H', 'e', 'a', 'd',
+                                       1};
+  header.push_back(static_cast<unsigned char>(audio.channels));
+  // No pre-skip, since the packets come from the middle of a stream
+  PutLE(header, 0, 2);
+  PutLE(header, granule_rate, 4);
+  // Output gain and mapping family
+  PutLE(header, 0, 2);
+  header.push_back(0);
+  writer.AddPacket(header.data(), header.size(), 0);
+  writer.Flush(0);
+
+  // Comment header
+  header = {'O', 'p', 'u', 's', 'T', 'a', 'g', 's'};
+  PutLE(header, std::strlen(vendor), 4);
+  header.insert(header.end(), vendor, vendor + std::strlen(vendor));
+  PutLE(header, 0, 4);
+  writer.AddPacket(header.data(), header.size(), 0);
+  writer.Flush(0);
+
+  // Audio data
+  int64_t granule = 0;
+  for (size_t i = 0; i < packets.Size(); i++) {
+    const opus_byte* packet = packets.PacketData(i);
+    const size_t size = packets.PacketLength(i);
+
+    granule += opus_packet_get_nb_samples(packet, size, granule_rate);
+    writer.AddPacket(packet, size, granule);
+  }
+  writer.Flush(page_flag_eos);
+
+  return audio;
+}
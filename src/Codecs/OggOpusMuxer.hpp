@@ -0,0 +1,19 @@
+#pragma once
+
+#include <opus/opus.h>
+#include <cstdint>
+#include <vector>
+#include "../Buffers/OpusPacketBuffer.hpp"
+#include "../types.h"
+
+// Muxes raw OPUS packets into an OggOpus stream without re-encoding them
+class OggOpusMuxer {
+ public:
+  // Whether the packets can be muxed as they are
+  // Every packet needs to be valid and all of them need to share the same
+  // channel count
+  static bool CanMux(const OpusPacketBuffer& packets);
+
+  // Muxes the packets into an OggOpus stream, expects CanMux to be true
+  static EncodedAudio Mux(const OpusPacketBuffer& packets);
+};
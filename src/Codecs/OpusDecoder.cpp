@@ -2,6 +2,12 @@
 
 // OPUS decoder constants
 constexpr int max_frame_size = 6 * 960;
+// The TOC byte and up to 2 bytes of frame data, e.g. the F8 FF FE silence
+// frame sent by Discord, or the 1 byte packets of the encoder's DTX
+constexpr size_t max_silence_packet_length = 3;
+constexpr size_t max_silence_frame_length = 2;
+// Frame count code in the lowest 2 bits of the TOC byte, 0 for a single frame
+constexpr opus_byte toc_code_mask = 0x03;
 
 OpusFrameDecoder::OpusFrameDecoder(int rate, int channels)
     : channels(channels), rate(rate) {
@@ -15,44 +21,64 @@ OpusFrameDecoder::OpusFrameDecoder(int rate, int channels)
 OpusFrameDecoder::~OpusFrameDecoder() { opus_decoder_destroy(decoder); }
 
 // Decode the specified OPUS frames
-std::vector<pcm_frame> OpusFrameDecoder::Decode(
-    const std::vector<opus_frame>& opus_frames) {
-  // Prevent concurrent decoding
-  std::lock_guard<std::mutex> lck(mt);
-  // Final return buffer
-  std::vector<opus_int16> pcm_buffer;
-  // Intermediate buffer for decoded output
-  // NOLINTNEXTLINE
-  opus_int16 pcm_output[channels * max_frame_size];
-  // Intermediate buffer for bit manipulation
-  // NOLINTNEXTLINE
-  unsigned char pcm_bytes[max_frame_size * channels * 2];
-
-  // Decode frame by frame
-  for (auto frame : opus_frames) {
-    int decoded_samples = opus_decode(decoder, frame.data(), frame.size(),
-                                      pcm_output, max_frame_size,
-                                      /* decode_fex */ 0);
+void OpusFrameDecoder::Decode(const OpusPacketBuffer& opus_frames,
+                              std::vector<pcm_frame>& output) {
+  // Decode frame by frame, straight into the output
+  for (size_t i = 0; i < opus_frames.Size(); i++) {
+    const opus_byte* data = opus_frames.PacketData(i);
+    const size_t length = opus_frames.PacketLength(i);
+    const size_t offset = output.size();
 
-    if (decoded_samples > 0) {
-      // Convert to little-endian ordering
-      for (int i = 0; i < channels * decoded_samples; i++) {
-        pcm_bytes[2 * i] = pcm_output[i] & 0xFF;             // NOLINT
-        pcm_bytes[2 * i + 1] = (pcm_output[i] >> 8) & 0xFF;  // NOLINT
+    // Keep the timing of silence packets without decoding them
+    if (IsSilencePacket(data, length)) {
+      const int silent_samples = opus_packet_get_nb_samples(data, length, rate);
+      if (silent_samples > 0) {
+        output.resize(offset + channels * silent_samples, 0);
       }
+      reset_pending = true;
+      continue;
+    }
+
+    // The decoder hasn't seen the skipped packets, so its prediction and
+    // overlap state still belong to the audio before them
+    if (reset_pending) {
+      opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+      reset_pending = false;
+    }
 
-      // Move back into an int16 format
-      size_t frame_buffer_size = channels * decoded_samples * 2 /
-                                 2;  // NOTE: BYTE->INT16, hence half the size
-      auto frame_buffer = reinterpret_cast<int16_t*>(pcm_bytes);
+    // The packet's sample count is known upfront, so the output only grows by
+    // the exact amount
+    const int frame_samples =
+        opus_decoder_get_nb_samples(decoder, data, length);
+    if (frame_samples <= 0 || frame_samples > max_frame_size) {
+      SPDLOG_ERROR("Failed to decode an Opus frame.");
+      continue;
+    }
 
-      // Add to the main buffer
-      pcm_buffer.insert(pcm_buffer.end(), frame_buffer,
-                        frame_buffer + frame_buffer_size);
+    output.resize(offset + channels * frame_samples);
+    const int decoded_samples =
+        opus_decode(decoder, data, length, output.data() + offset,
+                    frame_samples, /* decode_fec */ 0);
+
+    if (decoded_samples > 0) {
+      output.resize(offset + channels * decoded_samples);
     } else {
       SPDLOG_ERROR("Failed to decode an Opus frame.");
+      output.resize(offset);
     }
   }
+}
+
+bool OpusFrameDecoder::IsSilencePacket(const opus_byte* data, size_t length) {
+  // Empty packets signal a loss rather than silence
+  if (data == nullptr || length == 0 || length > max_silence_packet_length) {
+    return false;
+  }
 
-  return pcm_buffer;
+  // Only single frame packets whose frame has at most 2 bytes count as DTX,
+  // i.e. a bare TOC byte or a comfort noise frame like Discord's
+  // Multiple frame packets (codes 1 to 3) can be just as short, so they always
+  // go through the decoder
+  return (data[0] & toc_code_mask) == 0 &&
+         length - 1 <= max_silence_frame_length;
 }
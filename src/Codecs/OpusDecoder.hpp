@@ -2,12 +2,13 @@
 
 #include <opus/opus.h>
 #include <spdlog/spdlog.h>
-#include <mutex>
 #include <string>
 #include <vector>
+#include "../Buffers/OpusPacketBuffer.hpp"
 #include "../types.h"
 
 // Decodes RAW OPUS frames into PCM
+// Not thread safe, every instance is used by a single stream at a time
 class OpusFrameDecoder {
  public:
   OpusFrameDecoder(int rate, int channels);
@@ -15,15 +16,29 @@ class OpusFrameDecoder {
   OpusFrameDecoder(const OpusFrameDecoder&) = delete;
   OpusFrameDecoder(const OpusFrameDecoder&&) = delete;
 
-  // Decode the specified OPUS frames
-  std::vector<pcm_frame> Decode(const std::vector<opus_frame>& opus_frames);
+  // Decode the specified OPUS frames and append the samples to the output
+  // Reusing the output keeps its capacity, so decoding doesn't allocate once
+  // it has grown to the usual batch size
+  // Silence packets are not decoded, their samples are filled with zeros
+  // The decoder state is reset before the packet that follows them
+  void Decode(const OpusPacketBuffer& opus_frames,
+              std::vector<pcm_frame>& output);
+
+  // Marks silence packets that were skipped without calling Decode, so that
+  // the next decoded packet doesn't continue from the audio before them
+  void SkipSilence() { reset_pending = true; }
+
+  // Whether the packet is a DTX or silence frame, judging by its TOC byte and
+  // its size: a single frame (code 0) packet with at most 2 bytes of frame
+  // data, which is too small to carry any audible content
+  static bool IsSilencePacket(const opus_byte* data, size_t length);
 
  private:
-  // Lock
-  std::mutex mt;
   // Decoder handle
   OpusDecoder* decoder = nullptr;
   // Decoder settings
   int channels;
   int rate;
+  // Set after silence packets that bypassed the decoder
+  bool reset_pending = false;
 };
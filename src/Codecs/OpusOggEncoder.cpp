@@ -1,18 +1,14 @@
 #include "OpusOggEncoder.hpp"
+#include <stdexcept>
 
 // Encoder configuration
 constexpr int channels = 1;
 constexpr int rate = 16000;
 
-OpusOggEncoder::OpusOggEncoder(
-    std::function<void(std::vector<unsigned char> &)> cb) {
+OpusOggEncoder::OpusOggEncoder(std::function<void(EncodedAudio &)> cb) {
   this->cb = std::move(cb);
-};
-
-// Encodes the specified frames as OggOpus
-void OpusOggEncoder::Encode(const std::vector<pcm_frame> &pcm_frames) {
-  OggOpusEnc *enc;
-  OggOpusComments *comments;
+  enc_buffer.sample_rate = rate;
+  enc_buffer.channels = channels;
 
   // OpusEnc will invoke these callbacks during the encode process
   OpusEncCallbacks callbacks = {
@@ -40,20 +36,29 @@ void OpusOggEncoder::Encode(const std::vector<pcm_frame> &pcm_frames) {
     ope_comments_destroy(comments);
     throw std::runtime_error("Failed ope_encoder_create_callbacks");
   }
+};
 
-  // Add the data to the encoder and drain it
-  ope_encoder_write(enc, pcm_frames.data(), pcm_frames.size());
-  ope_encoder_drain(enc);
-
+OpusOggEncoder::~OpusOggEncoder() {
   // Cleanup
-  ope_comments_destroy(comments);
   ope_encoder_destroy(enc);
+  ope_comments_destroy(comments);
+}
+
+void OpusOggEncoder::Write(const pcm_frame *pcm_frames, size_t size) {
+  // Complete Opus frames are encoded right away, the rest is kept by the
+  // encoder until the next write
+  ope_encoder_write(enc, pcm_frames, size);
+}
+
+void OpusOggEncoder::Finish() {
+  // Encode the remaining data and flush the last page
+  ope_encoder_drain(enc);
 }
 
 void OpusOggEncoder::AddToEncodedDataBuffer(const unsigned char *ptr,
                                             opus_int32 len) {
   // Append the partial data to the buffer
-  enc_buffer.insert(enc_buffer.end(), ptr, ptr + len);
+  enc_buffer.data.insert(enc_buffer.data.end(), ptr, ptr + len);
 }
 
 void OpusOggEncoder::OnEncodingDone() {
@@ -8,18 +8,29 @@
 #include "../types.h"
 
 // Encoder PCM to OggOpus
+// The audio is encoded incrementally as it's written, so finishing only needs
+// to drain the last page
 class OpusOggEncoder {
  public:
-  explicit OpusOggEncoder(std::function<void(std::vector<unsigned char> &)> cb);
+  explicit OpusOggEncoder(std::function<void(EncodedAudio &)> cb);
+  OpusOggEncoder(const OpusOggEncoder &) = delete;
+  OpusOggEncoder(const OpusOggEncoder &&) = delete;
+  ~OpusOggEncoder();
 
   // Encodes the specified frames as OggOpus
-  void Encode(const std::vector<pcm_frame> &pcm_frames);
+  void Write(const pcm_frame *pcm_frames, size_t size);
+
+  // Drains the encoder and invokes the callback with the full encoded data
+  void Finish();
 
  private:
+  // Encoder handles
+  OggOpusEnc *enc = nullptr;
+  OggOpusComments *comments = nullptr;
   // Callback for when the encoding is done
-  std::function<void(std::vector<unsigned char> &)> cb;
+  std::function<void(EncodedAudio &)> cb;
   // Buffer to store the encoded data
-  std::vector<unsigned char> enc_buffer;
+  EncodedAudio enc_buffer;
 
   // Invoked as a callback when the partially encoded data is ready
   void AddToEncodedDataBuffer(const unsigned char *ptr, opus_int32 len);
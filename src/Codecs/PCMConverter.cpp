@@ -0,0 +1,208 @@
+#include "PCMConverter.hpp"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <stdexcept>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Supported input formats
+// The filter size grows with the reduced resampling ratio, so only the common
+// rates are accepted, which keep it below 32k taps
+constexpr std::array<int, 13> supported_input_rates = {
+    {8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000, 88200, 96000,
+     176400, 192000}};
+constexpr int max_input_channels = 8;
+// Filter taps per output sample for every decimated input sample, a multiple
+// of 8 to fill the SIMD registers
+constexpr size_t taps_per_decimation = 32;
+// Cutoff relative to the lower Nyquist frequency, leaving room for the
+// transition band
+constexpr double cutoff_ratio = 0.9;
+constexpr int coefficient_bits = 15;
+
+// Unnamed namespace for local utilities
+namespace {
+int GreatestCommonDivisor(int a, int b) {
+  while (b != 0) {
+    const int rest = a % b;
+    a = b;
+    b = rest;
+  }
+  return a;
+}
+
+// Dot product of a filter phase with the input samples, in the Q15 format
+// The tap count needs to be a multiple of 8
+int32_t FilterPhase(const int16_t* taps, const pcm_frame* input,
+                    size_t tap_count) {
+#ifdef __SSE2__
+  __m128i sum = _mm_setzero_si128();
+  for (size_t i = 0; i < tap_count; i += 8) {
+    const __m128i t =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(taps + i));
+    const __m128i x =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + i));
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(t, x));
+  }
+
+  // Horizontal sum of the 4 lanes
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+#else
+  int32_t sum = 0;
+  for (size_t i = 0; i < tap_count; i++) {
+    sum += static_cast<int32_t>(taps[i]) * input[i];
+  }
+  return sum;
+#endif
+}
+
+pcm_frame Saturate(int32_t value) {
+  return static_cast<pcm_frame>(
+      std::max<int32_t>(INT16_MIN, std::min<int32_t>(INT16_MAX, value)));
+}
+}  // namespace
+
+PCMConverter::PCMConverter(int input_rate, int input_channels,
+                           int output_rate)
+    : input_rate(input_rate), input_channels(input_channels) {
+  if (!IsSupported(input_rate, input_channels)) {
+    throw std::invalid_argument("Unsupported PCM input format");
+  }
+
+  const int divisor = GreatestCommonDivisor(output_rate, input_rate);
+  interpolation = output_rate / divisor;
+  decimation = input_rate / divisor;
+
+  // The filter gets steeper with the decimation, so that the transition band
+  // stays narrow relative to the output rate
+  taps_per_phase =
+      taps_per_decimation *
+      std::max(1, (decimation + interpolation - 1) / interpolation);
+
+  // Windowed sinc lowpass at the interpolated rate, below the Nyquist
+  // frequency of both the input and the output
+  const size_t length = taps_per_phase * interpolation;
+  const double cutoff =
+      cutoff_ratio * 0.5 / std::max(interpolation, decimation);
+  const double center = (length - 1) / 2.0;
+  std::vector<double> prototype(length);
+  for (size_t i = 0; i < length; i++) {
+    const double t = i - center;
+    const double sinc = t == 0 ? 1.0
+                               : std::sin(2 * M_PI * cutoff * t) /
+                                     (2 * M_PI * cutoff * t);
+    const double window = 0.42 - 0.5 * std::cos(2 * M_PI * i / (length - 1)) +
+                          0.08 * std::cos(4 * M_PI * i / (length - 1));
+    // Interpolation spreads the energy over the zero samples, so the gain
+    // compensates for it
+    prototype[i] = 2 * cutoff * interpolation * sinc * window;
+  }
+
+  // Output sample n uses the phase (n * decimation) % interpolation, which
+  // multiplies the taps phase + k * interpolation with the input samples
+  // going backwards from (n * decimation) / interpolation
+  coefficients.resize(length);
+  for (int phase = 0; phase < interpolation; phase++) {
+    int16_t* taps = coefficients.data() + phase * taps_per_phase;
+    for (size_t k = 0; k < taps_per_phase; k++) {
+      const double tap =
+          prototype[phase + k * interpolation] * (1 << coefficient_bits);
+      taps[taps_per_phase - 1 - k] =
+          Saturate(static_cast<int32_t>(std::lround(tap)));
+    }
+  }
+
+  // Start with silence as the history
+  mono.assign(taps_per_phase - 1, 0);
+  position = (taps_per_phase - 1) * interpolation;
+}
+
+bool PCMConverter::IsSupported(int input_rate, int input_channels) {
+  return std::find(supported_input_rates.begin(), supported_input_rates.end(),
+                   input_rate) != supported_input_rates.end() &&
+         input_channels >= 1 && input_channels <= max_input_channels;
+}
+
+bool PCMConverter::Matches(int input_rate, int input_channels) const {
+  return this->input_rate == input_rate &&
+         this->input_channels == input_channels;
+}
+
+void PCMConverter::Convert(const pcm_frame* data, size_t sample_count,
+                           std::vector<pcm_frame>& output) {
+  const size_t frame_count = sample_count / input_channels;
+
+  // Nothing to filter when the rate already matches
+  if (interpolation == decimation) {
+    Downmix(data, frame_count, output);
+    return;
+  }
+
+  Downmix(data, frame_count, mono);
+  Resample(output);
+}
+
+void PCMConverter::Downmix(const pcm_frame* data, size_t frame_count,
+                           std::vector<pcm_frame>& output) {
+  const size_t offset = output.size();
+  output.resize(offset + frame_count);
+  pcm_frame* out = output.data() + offset;
+
+  if (input_channels == 1) {
+    std::copy(data, data + frame_count, out);
+    return;
+  }
+
+  size_t i = 0;
+
+  if (input_channels == 2) {
+#ifdef __SSE2__
+    // Adding the pairs of neighbours sums the left and right samples
+    const __m128i ones = _mm_set1_epi16(1);
+    for (; i + 8 <= frame_count; i += 8) {
+      const __m128i first =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 2 * i));
+      const __m128i second =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 2 * i + 8));
+      const __m128i first_sums =
+          _mm_srai_epi32(_mm_madd_epi16(first, ones), 1);
+      const __m128i second_sums =
+          _mm_srai_epi32(_mm_madd_epi16(second, ones), 1);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                       _mm_packs_epi32(first_sums, second_sums));
+    }
+#endif
+  }
+
+  for (; i < frame_count; i++) {
+    int32_t sum = 0;
+    for (int channel = 0; channel < input_channels; channel++) {
+      sum += data[i * input_channels + channel];
+    }
+    out[i] = static_cast<pcm_frame>(sum / input_channels);
+  }
+}
+
+void PCMConverter::Resample(std::vector<pcm_frame>& output) {
+  // Produce every output sample that has all its input available
+  for (size_t last = position / interpolation; last < mono.size();
+       last = position / interpolation) {
+    const size_t phase = position % interpolation;
+    const int32_t sum =
+        FilterPhase(coefficients.data() + phase * taps_per_phase,
+                    mono.data() + last + 1 - taps_per_phase, taps_per_phase);
+    output.push_back(Saturate(
+        (sum + (1 << (coefficient_bits - 1))) >> coefficient_bits));
+    position += decimation;
+  }
+
+  // Keep the history for the next output sample
+  const size_t consumed = position / interpolation + 1 - taps_per_phase;
+  mono.erase(mono.begin(), mono.begin() + consumed);
+  position -= consumed * interpolation;
+}
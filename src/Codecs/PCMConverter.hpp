@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../types.h"
+
+// Converts interleaved PCM audio of any common format into mono audio at the
+// output rate
+// Channels are averaged, then the audio is resampled with a polyphase FIR
+// filter
+// Keeps the filter history between calls, so the audio of a stream needs to
+// be passed in order
+class PCMConverter {
+ public:
+  PCMConverter(int input_rate, int input_channels, int output_rate);
+  PCMConverter(const PCMConverter&) = delete;
+  PCMConverter(const PCMConverter&&) = delete;
+
+  // Whether the input format is supported
+  // The rate must be one of the common ones, from 8 kHz to 192 kHz
+  static bool IsSupported(int input_rate, int input_channels);
+
+  // Whether the converter was created for the specified input format
+  bool Matches(int input_rate, int input_channels) const;
+
+  // Converts the interleaved samples and appends the result to the output
+  // Trailing samples that don't make up a full frame are ignored
+  void Convert(const pcm_frame* data, size_t sample_count,
+               std::vector<pcm_frame>& output);
+
+ private:
+  int input_rate;
+  int input_channels;
+
+  // Reduced resampling ratio, the output has interpolation / decimation
+  // samples for every input sample
+  int interpolation;
+  int decimation;
+  // Filter length per output sample
+  size_t taps_per_phase;
+
+  // Filter taps of every phase, stored back to back in reverse order and in
+  // the Q15 format
+  std::vector<int16_t> coefficients;
+
+  // Downmixed input, starting with the history the filter still needs
+  std::vector<pcm_frame> mono;
+  // Position of the next output sample in the interpolated input
+  size_t position;
+
+  // Averages the channels of the input and appends the result to the output
+  void Downmix(const pcm_frame* data, size_t frame_count,
+               std::vector<pcm_frame>& output);
+  // Filters the buffered mono audio into the output
+  void Resample(std::vector<pcm_frame>& output);
+};
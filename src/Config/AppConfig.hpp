@@ -1,6 +1,33 @@
 #pragma once
+#include <cstddef>
 #include <string>
 
+// What to do with incoming frames when a stream's ingest ring is full
+enum class IngestOverflowPolicy {
+  // Queue the frames in a locked overflow buffer until the ring drains
+  Spill,
+  // Drop the frames and count them
+  Drop
+};
+
+// How the command audio gets uploaded for the speech recognition
+enum class CommandAudioMode {
+  // Decode the OPUS input and encode the PCM into a new OggOpus stream
+  Reencode,
+  // Mux the original OPUS packets into an OggOpus stream
+  Passthrough
+};
+
+// Speech recognition backend for the uploaded command audio
+enum class RecognizerType {
+  // GCloud Speech To Text REST API
+  Google,
+  // Self-hosted HTTP endpoint
+  HTTP,
+  // In-process engine with a fixed transcript, for load testing
+  Loopback
+};
+
 // Stores application configuration
 class AppConfig {
  public:
@@ -11,4 +38,44 @@ class AppConfig {
   int max_buffer_ttl_ms;
   int max_command_length_ms;
   int max_command_silence_length_ms;
+
+  // Optional settings
+  size_t ingest_ring_size = 16384;
+  IngestOverflowPolicy ingest_overflow_policy = IngestOverflowPolicy::Spill;
+  // Streams without input for this long are removed, 0 disables the eviction
+  int stream_idle_ttl_ms = 0;
+  // Max amount of audio awaiting the hotword detection per stream
+  int hotword_max_backlog_ms = 3000;
+  // Amount of Porcupine handles to initialize ahead of time
+  size_t pv_prewarm_count = 0;
+  CommandAudioMode command_audio_mode = CommandAudioMode::Reencode;
+  // Server that the command audio gets streamed to while it's being spoken,
+  // empty to upload it to GCloud once the command ends
+  std::string streaming_recognizer_url;
+  RecognizerType recognizer = RecognizerType::Google;
+  // Endpoint of the HTTP recognizer
+  std::string recognizer_url;
+  // Synthetic latency and output of the loopback recognizer
+  int loopback_latency_ms = 0;
+  std::string loopback_transcript;
+  // Skips the hotword detection for audio without speech
+  bool vad_enabled = true;
+  // Worker threads for the latency sensitive stream processing and for the
+  // command encoding, 0 to pick them based on the hardware concurrency
+  size_t realtime_threads = 0;
+  size_t bulk_threads = 0;
+  // Trailing silence that ends a command, 0 to rely on the
+  // max_command_silence_length_ms timeout only
+  int vad_end_silence_ms = 800;
+  // Max amount of undecoded audio per stream and across all the streams, 0
+  // disables the limit
+  // Audio over the limit is shed unless a command is being spoken
+  int stream_max_backlog_ms = 5000;
+  int max_backlog_ms = 0;
+  // File that the command stage spans get written to, empty to disable
+  std::string trace_path;
+  // Timeouts of the recognition requests, 0 disables them
+  // The timeout of a streamed request starts once its audio has been sent
+  int http_connect_timeout_ms = 10000;
+  int http_timeout_ms = 30000;
 };
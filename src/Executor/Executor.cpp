@@ -0,0 +1,161 @@
+#include "Executor.hpp"
+#include <algorithm>
+
+constexpr size_t Executor::no_worker;
+
+// Unnamed namespace for local utilities
+namespace {
+// Executor and worker index of the current thread
+thread_local const Executor* current_executor = nullptr;
+thread_local size_t current_worker = Executor::no_worker;
+}  // namespace
+
+Executor::Executor(std::string name, size_t thread_count)
+    : name(std::move(name)) {
+  thread_count = std::max<size_t>(1, thread_count);
+
+  for (size_t i = 0; i < thread_count; i++) {
+    workers.push_back(std::make_unique<Worker>());
+  }
+
+  for (size_t i = 0; i < thread_count; i++) {
+    threads.emplace_back(&Executor::Run, this, i);
+  }
+}
+
+Executor::~Executor() { Shutdown(); }
+
+void Executor::Shutdown() {
+  stopping = true;
+  for (auto& worker : workers) {
+    std::lock_guard<std::mutex> lk(worker->mt);
+    worker->cv.notify_one();
+  }
+
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  threads.clear();
+}
+
+void Executor::Post(task new_task) { Post(std::move(new_task), NextWorker()); }
+
+void Executor::Post(task new_task, size_t worker) {
+  const size_t index = worker % workers.size();
+  auto& target = *workers[index];
+  bool target_sleeping;
+
+  {
+    std::lock_guard<std::mutex> lk(target.mt);
+    target.tasks.push_back({std::move(new_task), clock::now()});
+    pending_tasks++;
+    target_sleeping = target.sleeping;
+    if (target_sleeping) {
+      target.cv.notify_one();
+    }
+  }
+
+  // The target worker is busy, so an idle one can take over the task
+  if (!target_sleeping) {
+    WakeThief(index);
+  }
+}
+
+size_t Executor::NextWorker() { return next_worker++ % workers.size(); }
+
+size_t Executor::CurrentWorker() const {
+  return current_executor == this ? current_worker : no_worker;
+}
+
+void Executor::Run(size_t index) {
+  current_executor = this;
+  current_worker = index;
+
+  auto& own = *workers[index];
+  QueuedTask current_task;
+  for (;;) {
+    if (TakeTask(index, current_task)) {
+      RecordQueueWait(clock::now() - current_task.posted);
+      current_task.run();
+      current_task.run = nullptr;
+      continue;
+    }
+
+    std::unique_lock<std::mutex> lk(own.mt);
+
+    // Tasks queued on other workers can still be stolen
+    if (!own.tasks.empty() || pending_tasks > 0) {
+      continue;
+    }
+
+    // The remaining tasks are run before stopping
+    if (stopping) {
+      return;
+    }
+
+    own.sleeping = true;
+    own.cv.wait(lk, [&own, this]() {
+      return !own.tasks.empty() || own.wake || stopping;
+    });
+    own.sleeping = false;
+    own.wake = false;
+  }
+}
+
+bool Executor::TakeTask(size_t index, QueuedTask& taken_task) {
+  {
+    auto& own = *workers[index];
+    std::lock_guard<std::mutex> lk(own.mt);
+    if (!own.tasks.empty()) {
+      taken_task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      pending_tasks--;
+      return true;
+    }
+  }
+
+  // Steal from the back, so that the victim keeps running its oldest tasks
+  for (size_t offset = 1; offset < workers.size(); offset++) {
+    auto& victim = *workers[(index + offset) % workers.size()];
+    std::lock_guard<std::mutex> lk(victim.mt);
+    if (!victim.tasks.empty()) {
+      taken_task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      pending_tasks--;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void Executor::WakeThief(size_t busy_index) {
+  for (size_t offset = 1; offset < workers.size(); offset++) {
+    auto& worker = *workers[(busy_index + offset) % workers.size()];
+    std::lock_guard<std::mutex> lk(worker.mt);
+    if (worker.sleeping && !worker.wake) {
+      worker.wake = true;
+      worker.cv.notify_one();
+      return;
+    }
+  }
+}
+
+void Executor::RecordQueueWait(clock::duration wait) {
+  const auto ticks = wait.count();
+  waited_task_count++;
+  total_wait += ticks;
+
+  auto current_max = max_wait.load();
+  while (ticks > current_max &&
+         !max_wait.compare_exchange_weak(current_max, ticks)) {
+  }
+}
+
+Executor::QueueWaitStats Executor::GetQueueWaitStats() const {
+  QueueWaitStats stats;
+  stats.task_count = waited_task_count;
+  stats.total_wait = clock::duration(total_wait);
+  stats.max_wait = clock::duration(max_wait);
+  return stats;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool
+// Every worker has its own task queue. Tasks posted with a worker hint stay on
+// that worker, unless it's busy while another one is idle and steals them
+class Executor {
+ public:
+  using task = std::function<void()>;
+  using clock = std::chrono::steady_clock;
+
+  // Time the tasks spent queued before a worker picked them up
+  struct QueueWaitStats {
+    uint64_t task_count = 0;
+    clock::duration total_wait = clock::duration::zero();
+    clock::duration max_wait = clock::duration::zero();
+  };
+
+  // Returned by CurrentWorker() outside of the worker threads
+  static constexpr size_t no_worker = static_cast<size_t>(-1);
+
+  // The name identifies the executor in the logs
+  Executor(std::string name, size_t thread_count);
+  Executor(const Executor&) = delete;
+  Executor(const Executor&&) = delete;
+  // Shuts the executor down, if it's still running
+  ~Executor();
+
+  // Runs the remaining tasks and joins the workers
+  // Must not be called from one of the workers, since they can't join
+  // themselves. Tasks posted afterwards are never run
+  void Shutdown();
+
+  // Queues the task on the next worker in a round robin order
+  void Post(task new_task);
+  // Queues the task on the specified worker
+  void Post(task new_task, size_t worker);
+
+  // Picks a worker in a round robin order
+  size_t NextWorker();
+  size_t ThreadCount() const { return workers.size(); }
+  const std::string& GetName() const { return name; }
+
+  // Queue wait statistics of the tasks run so far
+  QueueWaitStats GetQueueWaitStats() const;
+  // Amount of tasks waiting to run, including the ones queued inside strands
+  // A strand run that waits for a worker counts as a task of its own
+  size_t GetQueueDepth() const { return pending_tasks + strand_tasks; }
+
+  // Index of the worker that runs the calling thread in this executor
+  size_t CurrentWorker() const;
+
+ private:
+  // Strands count their queued tasks into strand_tasks
+  friend class Strand;
+
+  struct QueuedTask {
+    task run;
+    clock::time_point posted;
+  };
+
+  struct Worker {
+    std::mutex mt;
+    std::condition_variable cv;
+    std::deque<QueuedTask> tasks;
+    // Set while the worker waits for tasks
+    bool sleeping = false;
+    // Set to wake the worker up for stealing
+    bool wake = false;
+  };
+
+  std::string name;
+  std::vector<std::unique_ptr<Worker>> workers;
+  std::vector<std::thread> threads;
+  std::atomic<size_t> next_worker{0};
+  // Queued tasks across all the workers
+  std::atomic<size_t> pending_tasks{0};
+  // Tasks queued inside the strands, only used for the queue depth
+  std::atomic<size_t> strand_tasks{0};
+  std::atomic<bool> stopping{false};
+
+  // Queue wait statistics, in clock ticks
+  std::atomic<uint64_t> waited_task_count{0};
+  std::atomic<clock::rep> total_wait{0};
+  std::atomic<clock::rep> max_wait{0};
+
+  // Worker thread loop
+  void Run(size_t index);
+  // Takes the oldest task of the worker, or the newest task of another one
+  bool TakeTask(size_t index, QueuedTask& taken_task);
+  // Adds the queue wait of a task that is about to run to the statistics
+  void RecordQueueWait(clock::duration wait);
+  // Wakes up a sleeping worker other than the specified one to steal a task
+  void WakeThief(size_t busy_index);
+};
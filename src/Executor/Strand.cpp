@@ -0,0 +1,63 @@
+#include "Strand.hpp"
+
+// Tasks run per scheduling, so that a busy strand doesn't starve the other
+// ones sharing the worker
+constexpr size_t max_batch_size = 16;
+
+Strand::Strand(Executor& executor) : state(std::make_shared<State>()) {
+  state->executor = &executor;
+  state->home_worker = executor.NextWorker();
+}
+
+void Strand::Post(Executor::task new_task) {
+  size_t home_worker;
+  {
+    std::lock_guard<std::mutex> lk(state->mt);
+    state->tasks.push_back(std::move(new_task));
+    state->executor->strand_tasks.fetch_add(1, std::memory_order_relaxed);
+    if (state->scheduled) {
+      return;
+    }
+    state->scheduled = true;
+    home_worker = state->home_worker;
+  }
+
+  auto scheduled_state = state;
+  state->executor->Post([scheduled_state]() { Run(scheduled_state); },
+                        home_worker);
+}
+
+void Strand::Run(const std::shared_ptr<State>& state) {
+  // Follow the worker that actually runs the strand, e.g. after a steal
+  const size_t worker = state->executor->CurrentWorker();
+
+  Executor::task current_task;
+  for (size_t i = 0; i < max_batch_size; i++) {
+    {
+      std::lock_guard<std::mutex> lk(state->mt);
+      if (worker != Executor::no_worker) {
+        state->home_worker = worker;
+      }
+      if (state->tasks.empty()) {
+        state->scheduled = false;
+        return;
+      }
+      current_task = std::move(state->tasks.front());
+      state->tasks.pop_front();
+      state->executor->strand_tasks.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    current_task();
+    current_task = nullptr;
+  }
+
+  // Requeue the remaining tasks behind the other work of the worker
+  auto scheduled_state = state;
+  size_t home_worker;
+  {
+    std::lock_guard<std::mutex> lk(state->mt);
+    home_worker = state->home_worker;
+  }
+  state->executor->Post([scheduled_state]() { Run(scheduled_state); },
+                        home_worker);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "Executor.hpp"
+
+// Runs tasks on an executor one at a time, in the order they were posted
+// Tasks of a strand don't need any locking between each other
+// The strand sticks to the worker it last ran on, so that the state of its
+// owner stays in that core's cache
+class Strand {
+ public:
+  // The executor must outlive the tasks of the strand
+  explicit Strand(Executor& executor);
+  Strand(const Strand&) = delete;
+  Strand(const Strand&&) = delete;
+
+  // Queues a task to run after the previously posted ones
+  void Post(Executor::task new_task);
+
+ private:
+  // Shared with the scheduled runs, so that a strand can be destroyed by its
+  // own last task
+  // The executor isn't owned, so that it can't be destroyed on its own worker
+  // when the last strand goes away
+  struct State {
+    Executor* executor;
+    std::mutex mt;
+    std::deque<Executor::task> tasks;
+    // Set while a run is queued or running on the executor
+    bool scheduled = false;
+    // Worker that runs the strand
+    size_t home_worker = 0;
+  };
+
+  std::shared_ptr<State> state;
+
+  // Runs the queued tasks, yielding the worker after a batch of them
+  static void Run(const std::shared_ptr<State>& state);
+};
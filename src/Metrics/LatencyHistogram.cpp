@@ -0,0 +1,112 @@
+#include "LatencyHistogram.hpp"
+#include <algorithm>
+
+constexpr int LatencyHistogram::sub_bucket_bits;
+constexpr uint64_t LatencyHistogram::sub_bucket_count;
+constexpr int LatencyHistogram::max_exponent;
+constexpr size_t LatencyHistogram::bucket_count;
+
+// Unnamed namespace for local utilities
+namespace {
+// Index of the highest set bit, the value must not be 0
+int HighestBit(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return 63 - __builtin_clzll(value);
+#else
+  int bit = 0;
+  while (value >>= 1) {
+    bit++;
+  }
+  return bit;
+#endif
+}
+}  // namespace
+
+LatencyHistogram::LatencyHistogram() {
+  for (auto& bucket : buckets) {
+    bucket.store(0, std::memory_order_relaxed);
+  }
+}
+
+void LatencyHistogram::Record(clock::duration value) {
+  const auto us =
+      std::chrono::duration_cast<std::chrono::microseconds>(value).count();
+  const uint64_t clamped = std::min<uint64_t>(
+      std::max<decltype(us)>(us, 0), (uint64_t(1) << max_exponent) - 1);
+
+  // The values are only summarized, so they don't need any ordering
+  buckets[BucketIndex(clamped)].fetch_add(1, std::memory_order_relaxed);
+  total_count.fetch_add(1, std::memory_order_relaxed);
+  total_value.fetch_add(clamped, std::memory_order_relaxed);
+
+  auto current_max = max_value.load(std::memory_order_relaxed);
+  while (clamped > current_max &&
+         !max_value.compare_exchange_weak(current_max, clamped,
+                                          std::memory_order_relaxed)) {
+  }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const {
+  Snapshot snapshot;
+
+  // The bucket counts are the source of truth for the percentiles, since the
+  // total count may already include a recording that the buckets don't
+  std::array<uint64_t, bucket_count> counts;
+  for (size_t i = 0; i < bucket_count; i++) {
+    counts[i] = buckets[i].load(std::memory_order_relaxed);
+    snapshot.count += counts[i];
+  }
+  if (snapshot.count == 0) {
+    return snapshot;
+  }
+
+  snapshot.max = max_value.load(std::memory_order_relaxed);
+  snapshot.mean =
+      static_cast<double>(total_value.load(std::memory_order_relaxed)) /
+      std::max<uint64_t>(total_count.load(std::memory_order_relaxed), 1);
+
+  // Walk the buckets once, filling the percentiles in increasing order
+  const std::array<std::pair<double, uint64_t*>, 4> percentiles = {{
+      {0.5, &snapshot.p50},
+      {0.9, &snapshot.p90},
+      {0.99, &snapshot.p99},
+      {0.999, &snapshot.p999},
+  }};
+  size_t next_percentile = 0;
+  uint64_t seen = 0;
+  for (size_t i = 0; i < bucket_count && next_percentile < percentiles.size();
+       i++) {
+    seen += counts[i];
+    while (next_percentile < percentiles.size() &&
+           seen >= percentiles[next_percentile].first * snapshot.count) {
+      *percentiles[next_percentile++].second =
+          std::min(BucketValue(i), snapshot.max);
+    }
+  }
+
+  return snapshot;
+}
+
+size_t LatencyHistogram::BucketIndex(uint64_t value) {
+  if (value < sub_bucket_count) {
+    return value;
+  }
+
+  // The bits below the top sub_bucket_bits + 1 ones only add precision that
+  // the buckets don't keep
+  const int exponent = HighestBit(value);
+  const int shift = exponent - sub_bucket_bits;
+  return (exponent - sub_bucket_bits + 1) * sub_bucket_count +
+         ((value >> shift) & (sub_bucket_count - 1));
+}
+
+uint64_t LatencyHistogram::BucketValue(size_t index) {
+  if (index < sub_bucket_count) {
+    return index;
+  }
+
+  const int shift = index / sub_bucket_count - 1;
+  const uint64_t sub_bucket = index % sub_bucket_count;
+  const uint64_t low = (sub_bucket_count + sub_bucket) << shift;
+  return low + ((uint64_t(1) << shift) >> 1);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// Lock-free latency histogram with log-linear buckets, similar to HDR
+// Histogram
+// Every power of two range is split into 8 buckets, so the recorded values
+// keep ~12% precision from 1us up to days
+class LatencyHistogram {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // Summary of the recorded values, in microseconds
+  struct Snapshot {
+    uint64_t count = 0;
+    double mean = 0;
+    uint64_t max = 0;
+    uint64_t p50 = 0;
+    uint64_t p90 = 0;
+    uint64_t p99 = 0;
+    uint64_t p999 = 0;
+  };
+
+  LatencyHistogram();
+  LatencyHistogram(const LatencyHistogram&) = delete;
+  LatencyHistogram(const LatencyHistogram&&) = delete;
+
+  // Records a value, negative durations count as 0
+  void Record(clock::duration value);
+
+  // Summarizes the values recorded so far
+  // Concurrent recordings may or may not be included
+  Snapshot GetSnapshot() const;
+
+ private:
+  // Bucket layout: values below 2^sub_bucket_bits get a bucket each, every
+  // power of two above that is split into 2^sub_bucket_bits buckets
+  static constexpr int sub_bucket_bits = 3;
+  static constexpr uint64_t sub_bucket_count = 1 << sub_bucket_bits;
+  // Values are capped at 2^max_exponent us, about 12 days
+  static constexpr int max_exponent = 40;
+  static constexpr size_t bucket_count =
+      (max_exponent - sub_bucket_bits + 2) * sub_bucket_count;
+
+  std::array<std::atomic<uint64_t>, bucket_count> buckets;
+  std::atomic<uint64_t> total_count{0};
+  std::atomic<uint64_t> total_value{0};
+  std::atomic<uint64_t> max_value{0};
+
+  static size_t BucketIndex(uint64_t value);
+  // Middle of the value range covered by a bucket
+  static uint64_t BucketValue(size_t index);
+};
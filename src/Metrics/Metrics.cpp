@@ -0,0 +1,42 @@
+#include "Metrics.hpp"
+
+constexpr size_t Metrics::stage_count;
+constexpr size_t Metrics::counter_count;
+
+// Static members
+std::array<LatencyHistogram, Metrics::stage_count> Metrics::histograms;
+std::array<std::atomic<uint64_t>, Metrics::counter_count> Metrics::counters{};
+
+const char* Metrics::GetName(Stage stage) {
+  switch (stage) {
+    case Stage::OpusDecode:
+      return "opusDecode";
+    case Stage::HotwordCheck:
+      return "hotwordCheck";
+    case Stage::CommandEncode:
+      return "commandEncode";
+    case Stage::RecognizerRoundTrip:
+      return "recognizerRoundTrip";
+    case Stage::HotwordToCallback:
+      return "hotwordToCallback";
+    default:
+      return "unknown";
+  }
+}
+
+const char* Metrics::GetName(Counter counter) {
+  switch (counter) {
+    case Counter::FramesReceived:
+      return "framesReceived";
+    case Counter::FramesDropped:
+      return "framesDropped";
+    case Counter::HotwordsDetected:
+      return "hotwordsDetected";
+    case Counter::CommandsCompleted:
+      return "commandsCompleted";
+    case Counter::CommandErrors:
+      return "commandErrors";
+    default:
+      return "unknown";
+  }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "LatencyHistogram.hpp"
+
+// A static class with the process wide counters and latency histograms of the
+// pipeline
+// Recording only takes relaxed atomic operations, so it's cheap enough for the
+// per-frame paths
+class Metrics {
+ public:
+  using clock = LatencyHistogram::clock;
+
+  // Timed pipeline stages
+  enum class Stage {
+    // Decoding of an OPUS batch
+    OpusDecode,
+    // Hotword check of a PCM batch
+    HotwordCheck,
+    // Encoding of a whole command, summed over its batches
+    CommandEncode,
+    // From the end of a command to the final recognition result
+    RecognizerRoundTrip,
+    // From the hotword detection to the final command callback
+    HotwordToCallback,
+    Count
+  };
+
+  // Event counters
+  enum class Counter {
+    // OPUS frames and PCM batches added to the streams
+    FramesReceived,
+    // OPUS frames dropped by the ingest ring or the backlog limits, and PCM
+    // batches dropped by the backlog limits, where every shedding of the
+    // oldest PCM backlog of a stream counts as one
+    FramesDropped,
+    HotwordsDetected,
+    // Final command results, and the ones that failed
+    CommandsCompleted,
+    CommandErrors,
+    Count
+  };
+
+  static constexpr size_t stage_count = static_cast<size_t>(Stage::Count);
+  static constexpr size_t counter_count = static_cast<size_t>(Counter::Count);
+
+  static void Record(Stage stage, clock::duration value) {
+    histograms[static_cast<size_t>(stage)].Record(value);
+  }
+
+  static void Increment(Counter counter, uint64_t amount = 1) {
+    counters[static_cast<size_t>(counter)].fetch_add(
+        amount, std::memory_order_relaxed);
+  }
+
+  static LatencyHistogram::Snapshot GetSnapshot(Stage stage) {
+    return histograms[static_cast<size_t>(stage)].GetSnapshot();
+  }
+
+  static uint64_t GetCount(Counter counter) {
+    return counters[static_cast<size_t>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  // Names exposed to JS
+  static const char* GetName(Stage stage);
+  static const char* GetName(Counter counter);
+
+ private:
+  static std::array<LatencyHistogram, stage_count> histograms;
+  static std::array<std::atomic<uint64_t>, counter_count> counters;
+};
@@ -0,0 +1,140 @@
+#include "Tracer.hpp"
+#include <algorithm>
+
+// Max amount of spans waiting for the writer
+constexpr size_t max_pending_spans = 65536;
+
+std::mutex Tracer::global_mt;
+std::condition_variable Tracer::cv;
+std::thread Tracer::th;
+std::vector<Tracer::Span> Tracer::pending_spans;
+uint64_t Tracer::dropped_spans = 0;
+FILE* Tracer::output = nullptr;
+Tracer::clock::time_point Tracer::trace_start;
+bool Tracer::run = false;
+std::atomic<bool> Tracer::enabled{false};
+std::atomic<Tracer::trace_id> Tracer::next_id{1};
+
+void Tracer::Writer() {
+  std::vector<Span> writing_spans;
+  std::unique_lock<std::mutex> lck(global_mt);
+
+  for (;;) {
+    cv.wait(lck, []() { return !run || !pending_spans.empty(); });
+    if (pending_spans.empty()) {
+      break;
+    }
+
+    // Write without holding the lock, so that recording doesn't wait for the
+    // file I/O
+    // Swapping keeps the capacity of both vectors
+    std::swap(writing_spans, pending_spans);
+    lck.unlock();
+    for (const auto& span : writing_spans) {
+      WriteSpan(span);
+    }
+    fflush(output);
+    writing_spans.clear();
+    lck.lock();
+  }
+}
+
+void Tracer::WriteSpan(const Span& span) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  const auto start =
+      duration_cast<microseconds>(span.start - trace_start).count();
+  const auto duration =
+      duration_cast<microseconds>(span.end - span.start).count();
+
+  // Every event is preceded by a separator, so the array stays valid JSON
+  // once it's closed, and readable by the trace viewers until then
+  fprintf(output,
+          ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%llu,\"ts\":%lld,"
+          "\"dur\":%lld,\"args\":{\"traceId\":%llu",
+          span.name, static_cast<unsigned long long>(span.id),
+          static_cast<long long>(start),
+          static_cast<long long>(std::max<decltype(duration)>(duration, 0)),
+          static_cast<unsigned long long>(span.id));
+  if (span.detail) {
+    fprintf(output, ",\"detail\":\"%s\"", span.detail);
+  }
+  fputs("}}", output);
+}
+
+void Tracer::Start(const std::string& path) {
+  std::lock_guard<std::mutex> lck(global_mt);
+
+  if (th.joinable()) {
+    SPDLOG_WARN("Tracer::Start : Already writing a trace, ignoring {}.", path);
+    return;
+  }
+
+  output = fopen(path.c_str(), "w");
+  if (!output) {
+    SPDLOG_ERROR("Tracer::Start : Failed to open the trace file {}.", path);
+    return;
+  }
+
+  // The metadata event names the process, and lets every following event
+  // start with a separator
+  fputs(
+      "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+      "\"args\":{\"name\":\"Voice commands\"}}",
+      output);
+
+  trace_start = clock::now();
+  dropped_spans = 0;
+  run = true;
+  enabled = true;
+  th = std::thread(&Tracer::Writer);
+}
+
+void Tracer::Stop() {
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    enabled = false;
+    run = false;
+  }
+  cv.notify_one();
+
+  // Join without holding the lock, since the writer needs it to exit
+  if (!th.joinable()) {
+    return;
+  }
+  th.join();
+
+  fputs("\n]\n", output);
+  fclose(output);
+  output = nullptr;
+
+  if (dropped_spans > 0) {
+    SPDLOG_WARN("Tracer::Stop : {} spans were dropped due to a full queue.",
+                dropped_spans);
+  }
+}
+
+void Tracer::RecordSpan(trace_id id, const char* name, clock::time_point start,
+                        clock::time_point end, const char* detail) {
+  if (!enabled) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lck(global_mt);
+  if (!run) {
+    return;
+  }
+
+  if (pending_spans.size() >= max_pending_spans) {
+    dropped_spans++;
+    return;
+  }
+
+  // Only the first span of a batch needs to wake up the writer
+  const bool notify = pending_spans.empty();
+  pending_spans.push_back({id, name, detail, start, end});
+  if (notify) {
+    cv.notify_one();
+  }
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// A static class that records the stage spans of the commands and writes them
+// to a Chrome trace event JSON file in the background
+// The file can be opened in chrome://tracing or Perfetto, where every command
+// gets its own track
+class Tracer {
+ public:
+  using clock = std::chrono::steady_clock;
+  using trace_id = uint64_t;
+
+ private:
+  // Recorded span
+  // The names point to string literals, so nothing gets copied
+  struct Span {
+    trace_id id;
+    const char* name;
+    const char* detail;
+    clock::time_point start;
+    clock::time_point end;
+  };
+
+  // Lock
+  static std::mutex global_mt;
+  // Wakes up the writer when spans are recorded
+  static std::condition_variable cv;
+  // Thread handle
+  static std::thread th;
+  // Spans waiting for the writer, bounded by max_pending_spans
+  static std::vector<Span> pending_spans;
+  // Spans dropped due to a full queue
+  static uint64_t dropped_spans;
+  // Output file, only used by the writer
+  static FILE* output;
+  // Timestamps are written relative to the start of the trace
+  static clock::time_point trace_start;
+  // Start/stop toggle
+  static bool run;
+  // Set while spans are being recorded
+  static std::atomic<bool> enabled;
+  // Identifier of the next command
+  static std::atomic<trace_id> next_id;
+
+  // The thread worker responsible for writing the spans
+  static void Writer();
+  // Writes a span as a complete trace event
+  static void WriteSpan(const Span& span);
+
+ public:
+  // Start writing the spans to the file
+  // The file is overwritten, nothing is recorded if it can't be opened
+  static void Start(const std::string& path);
+  // Write the remaining spans and close the file
+  static void Stop();
+  // Returns a new unique command identifier
+  // Identifiers are assigned even when the spans aren't recorded
+  static trace_id NextTraceId() { return next_id++; }
+  // Whether the spans are being recorded
+  static bool IsEnabled() { return enabled; }
+  // Records a span of a command stage
+  // The name and the optional detail must be string literals
+  // Dropped when the writer falls behind
+  static void RecordSpan(trace_id id, const char* name, clock::time_point start,
+                         clock::time_point end, const char* detail = nullptr);
+};
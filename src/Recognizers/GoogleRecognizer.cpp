@@ -0,0 +1,33 @@
+#include "GoogleRecognizer.hpp"
+
+GoogleRecognizer::GoogleRecognizer(std::string api_key)
+    : api(std::move(api_key)) {}
+
+void GoogleRecognizer::Recognize(EncodedAudio&& audio,
+                                 result_callback cb) {
+  // Invoke speech to text parsing
+  api.GetTextFromOggOpus(audio, [cb](HTTPResponse& response) {
+    // Error responses have a JSON body with the details, so they're parsed too
+    // unless nothing was received
+    CommandResult result;
+    if (response.code != CURLE_OK) {
+      result.status = CommandStatus::Error;
+      result.error = response.Error();
+    } else {
+      result = GSpeechResponseParser::Parse(response.body);
+      if (result.status != CommandStatus::Error && !response.Ok()) {
+        result.status = CommandStatus::Error;
+        result.error = response.Error();
+      }
+    }
+
+    if (result.status == CommandStatus::Error) {
+      SPDLOG_ERROR("GoogleRecognizer::Recognize : {}", result.error);
+    }
+
+    SPDLOG_DEBUG("GoogleRecognizer::Recognize : Text data is: {}",
+                 result.transcript);
+
+    cb(result);
+  });
+}
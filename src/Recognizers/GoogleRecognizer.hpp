@@ -0,0 +1,18 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+#include <string>
+#include "../APIs/GSpeechResponseParser.hpp"
+#include "../APIs/GSpeechToText.hpp"
+#include "Recognizer.hpp"
+
+// Recognizes the commands with the GCloud Speech To Text REST API
+class GoogleRecognizer : public Recognizer {
+ public:
+  explicit GoogleRecognizer(std::string api_key);
+
+  void Recognize(EncodedAudio&& audio, result_callback cb) override;
+
+ private:
+  GSpeechToText api;
+};
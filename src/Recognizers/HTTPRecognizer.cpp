@@ -0,0 +1,38 @@
+#include "HTTPRecognizer.hpp"
+
+HTTPRecognizer::HTTPRecognizer(std::string url) { this->url = std::move(url); }
+
+void HTTPRecognizer::Recognize(EncodedAudio&& audio, result_callback cb) {
+  const std::string content_type =
+      "audio/ogg; codecs=opus; rate=" + std::to_string(audio.sample_rate) +
+      "; channels=" + std::to_string(audio.channels);
+
+  HTTPClient::Post(
+      url, content_type, std::move(audio.data), [cb](HTTPResponse& response) {
+        CommandResult result;
+        if (!response.Ok()) {
+          result.status = CommandStatus::Error;
+          result.error = response.Error();
+          SPDLOG_ERROR("HTTPRecognizer::Recognize : {}", result.error);
+          cb(result);
+          return;
+        }
+
+        auto parsed_data = nlohmann::json::parse(response.body, nullptr, false);
+        if (parsed_data.is_object() && parsed_data["transcript"].is_string()) {
+          result.transcript = parsed_data["transcript"];
+          if (parsed_data["confidence"].is_number()) {
+            result.confidence = parsed_data["confidence"];
+          }
+        } else {
+          result.status = CommandStatus::Error;
+          result.error = "Invalid response: " + response.body;
+          SPDLOG_ERROR("HTTPRecognizer::Recognize : {}", result.error);
+        }
+
+        SPDLOG_DEBUG("HTTPRecognizer::Recognize : Text data is: {}",
+                     result.transcript);
+
+        cb(result);
+      });
+}
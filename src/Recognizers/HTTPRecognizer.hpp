@@ -0,0 +1,21 @@
+#pragma once
+
+#include <spdlog/spdlog.h>
+#include <nlohmann/json.hpp>
+#include <string>
+#include "../APIs/HTTPClient.hpp"
+#include "Recognizer.hpp"
+
+// Recognizes the commands with a self-hosted HTTP endpoint
+// The OggOpus audio is posted as the request body and the endpoint responds
+// with a JSON object: {"transcript": string, "confidence": number}, where the
+// confidence is optional
+class HTTPRecognizer : public Recognizer {
+ public:
+  explicit HTTPRecognizer(std::string url);
+
+  void Recognize(EncodedAudio&& audio, result_callback cb) override;
+
+ private:
+  std::string url;
+};
@@ -0,0 +1,27 @@
+#include "LoopbackRecognizer.hpp"
+
+LoopbackRecognizer::LoopbackRecognizer(int latency_ms, std::string transcript)
+    : latency(latency_ms) {
+  this->transcript = std::move(transcript);
+}
+
+void LoopbackRecognizer::Recognize(EncodedAudio&& audio,
+                                   result_callback cb) {
+  CommandResult result;
+  result.transcript = transcript;
+
+  if (latency.count() <= 0) {
+    cb(result);
+    return;
+  }
+
+  // Deliver the result from the sync thread once the latency passes, the same
+  // way a response would arrive without blocking the calling thread
+  auto id = std::make_shared<Ticker::callback_id>(0);
+  *id = Ticker::RegisterCallback([id, cb, result]() mutable {
+    cb(result);
+    Ticker::UnregisterCallback(*id);
+    return sync_clock::time_point::max();
+  });
+  Ticker::Schedule(*id, sync_clock::now() + latency);
+}
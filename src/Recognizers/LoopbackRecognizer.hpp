@@ -0,0 +1,20 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include "../Ticker/Ticker.hpp"
+#include "Recognizer.hpp"
+
+// In-process recognizer that returns a fixed transcript after a synthetic
+// delay, to load test the pipeline without a network
+class LoopbackRecognizer : public Recognizer {
+ public:
+  LoopbackRecognizer(int latency_ms, std::string transcript);
+
+  void Recognize(EncodedAudio&& audio, result_callback cb) override;
+
+ private:
+  std::chrono::milliseconds latency;
+  std::string transcript;
+};
@@ -0,0 +1,18 @@
+#include "Recognizer.hpp"
+#include "GoogleRecognizer.hpp"
+#include "HTTPRecognizer.hpp"
+#include "LoopbackRecognizer.hpp"
+
+std::shared_ptr<Recognizer> Recognizer::Create(const AppConfig& config) {
+  switch (config.recognizer) {
+    case RecognizerType::HTTP:
+      return std::make_shared<HTTPRecognizer>(config.recognizer_url);
+    case RecognizerType::Loopback:
+      return std::make_shared<LoopbackRecognizer>(config.loopback_latency_ms,
+                                                  config.loopback_transcript);
+    case RecognizerType::Google:
+    default:
+      return std::make_shared<GoogleRecognizer>(
+          config.g_speech_to_text_api_key);
+  }
+}
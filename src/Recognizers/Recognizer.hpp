@@ -0,0 +1,25 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include "../Config/AppConfig.hpp"
+#include "../types.h"
+
+// Speech recognition backend that turns the encoded command audio into text
+// A single instance is shared by all the streams, so implementations need to
+// be thread safe
+class Recognizer {
+ public:
+  using result_callback = std::function<void(CommandResult&)>;
+
+  virtual ~Recognizer() = default;
+
+  // Creates the backend selected in the configuration
+  static std::shared_ptr<Recognizer> Create(const AppConfig& config);
+
+  // Recognizes the command audio and invokes the callback with the final
+  // result
+  // Takes the audio over, so that it can be uploaded without a copy
+  virtual void Recognize(EncodedAudio&& audio, result_callback cb) = 0;
+};
@@ -1,41 +1,75 @@
 #include "Ticker.hpp"
 
-// Unnamed namespace for local utilities
-namespace {
-std::chrono::milliseconds GetCurrentTimeStamp() {
-  return std::chrono::duration_cast<std::chrono::milliseconds>(
-      std::chrono::system_clock::now().time_since_epoch());
-}
-}  // namespace
-
-constexpr int tick_delay = 100;
-
 std::mutex Ticker::global_mt;
+std::condition_variable Ticker::cv;
+std::condition_variable Ticker::callback_done_cv;
 std::thread Ticker::th;
-std::vector<std::function<void(void)>> Ticker::callbacks;
-bool Ticker::run = true;
-std::chrono::milliseconds Ticker::delay = std::chrono::milliseconds(tick_delay);
+std::unordered_map<Ticker::callback_id, Ticker::Entry> Ticker::callbacks;
+std::priority_queue<Ticker::Deadline, std::vector<Ticker::Deadline>,
+                    std::greater<Ticker::Deadline>>
+    Ticker::deadlines;
+Ticker::callback_id Ticker::next_id = 1;
+Ticker::callback_id Ticker::running_id = 0;
+bool Ticker::run = false;
 
 void Ticker::Worker() {
-  auto sleep_delay = delay;
+  std::unique_lock<std::mutex> lck(global_mt);
   while (run) {
-    std::this_thread::sleep_for(sleep_delay);
-    std::lock_guard<std::mutex> lck(global_mt);
-    auto init_time = GetCurrentTimeStamp();
-    SPDLOG_TRACE("Ticker::worker : Starting loop for {} callbacks.",
-                 callbacks.size());
-    for (const auto &cb : callbacks) {
-      cb();
+    if (deadlines.empty()) {
+      cv.wait(lck);
+      continue;
+    }
+
+    const auto next = deadlines.top();
+    auto it = callbacks.find(next.id);
+    if (it == callbacks.end() || it->second.deadline != next.deadline) {
+      // Stale entry
+      deadlines.pop();
+      continue;
+    }
+
+    if (next.deadline > sync_clock::now()) {
+      // Sleep until the deadline, or until an earlier one gets scheduled
+      cv.wait_until(lck, next.deadline);
+      continue;
+    }
+
+    deadlines.pop();
+    it->second.deadline = sync_clock::time_point::max();
+
+    SPDLOG_TRACE("Ticker::worker : Invoking callback {}, late by {}us.",
+                 next.id,
+                 std::chrono::duration_cast<std::chrono::microseconds>(
+                     sync_clock::now() - next.deadline)
+                     .count());
+
+    // Invoke without holding the lock, so that the callback and other threads
+    // can schedule new deadlines
+    // Map nodes are stable, so the entry stays valid while unlocked
+    auto& entry = it->second;
+    running_id = next.id;
+    lck.unlock();
+    auto next_deadline = entry.cb();
+    lck.lock();
+    running_id = 0;
+
+    if (entry.removed) {
+      callbacks.erase(next.id);
+    } else {
+      AddDeadline(entry, next.id, next_deadline);
     }
+    callback_done_cv.notify_all();
+  }
+}
 
-    // Make the callback intervals as consistent as possible via tracking the
-    // time spent on invoking them
-    auto current_time = GetCurrentTimeStamp();
-    auto time_diff = current_time - init_time;
-    auto sleep_delay = delay - time_diff;
-    SPDLOG_TRACE("Ticker::worker : Loop took {}ms. Sleeping for {}ms.",
-                 time_diff.count(), sleep_delay.count());
+void Ticker::AddDeadline(Entry& entry, callback_id id,
+                         sync_clock::time_point deadline) {
+  if (deadline >= entry.deadline) {
+    return;
   }
+
+  entry.deadline = deadline;
+  deadlines.push({deadline, id});
 }
 
 void Ticker::Start() {
@@ -43,19 +77,68 @@ void Ticker::Start() {
 
   // Initialize the thread
   if (!th.joinable()) {
+    run = true;
     th = std::thread(&Ticker::Worker);
   }
 }
 
 void Ticker::Stop() {
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    run = false;
+  }
+  cv.notify_one();
+
+  // Join without holding the lock, since the worker needs it to exit
+  if (th.joinable()) {
+    th.join();
+  }
+}
+
+Ticker::callback_id Ticker::RegisterCallback(sync_callback cb) {
   std::lock_guard<std::mutex> lck(global_mt);
+  auto id = next_id++;
+  callbacks[id].cb = std::move(cb);
+  return id;
+}
 
-  // Stop the thread and join
-  run = false;
-  th.join();
+void Ticker::UnregisterCallback(callback_id id) {
+  std::unique_lock<std::mutex> lck(global_mt);
+
+  auto it = callbacks.find(id);
+  if (it == callbacks.end()) {
+    return;
+  }
+
+  if (running_id == id) {
+    // The callback is unregistering itself, so let the worker erase it once
+    // the invocation returns
+    if (std::this_thread::get_id() == th.get_id()) {
+      it->second.removed = true;
+      return;
+    }
+
+    callback_done_cv.wait(lck, [id]() { return running_id != id; });
+  }
+
+  // Stale deadlines of the removed callback are skipped by the worker
+  callbacks.erase(id);
 }
 
-void Ticker::RegisterCallback(std::function<void(void)> cb) {
+void Ticker::Schedule(callback_id id, sync_clock::time_point deadline) {
   std::lock_guard<std::mutex> lck(global_mt);
-  callbacks.push_back(std::move(cb));
+
+  auto it = callbacks.find(id);
+  if (it == callbacks.end()) {
+    return;
+  }
+
+  // Only wake up the worker if this is the new earliest deadline
+  const bool is_earliest =
+      deadlines.empty() || deadline < deadlines.top().deadline;
+  AddDeadline(it->second, id, deadline);
+
+  if (is_earliest) {
+    cv.notify_one();
+  }
 }
@@ -2,34 +2,90 @@
 
 #include <spdlog/spdlog.h>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <mutex>
+#include <queue>
 #include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
-// A static class that invokes synchronization callbacks at fixed intervals
+// Clock used for all the sync deadlines
+using sync_clock = std::chrono::steady_clock;
+
+// A static class that invokes synchronization callbacks at their deadlines
+// Every callback returns its next deadline, so callbacks that have nothing to
+// do aren't invoked at all
 class Ticker {
+ public:
+  using callback_id = uint64_t;
+  // Returns the next deadline, or sync_clock::time_point::max() if none
+  using sync_callback = std::function<sync_clock::time_point(void)>;
+
  private:
+  // Registered callback with its pending deadline
+  struct Entry {
+    sync_callback cb;
+    sync_clock::time_point deadline = sync_clock::time_point::max();
+    // Set when the callback unregisters itself while being invoked
+    bool removed = false;
+  };
+
+  // Deadline queue entry
+  // Entries whose deadline doesn't match the callback's current one are stale
+  // and get skipped
+  struct Deadline {
+    sync_clock::time_point deadline;
+    callback_id id;
+
+    bool operator>(const Deadline& other) const {
+      return deadline > other.deadline;
+    }
+  };
+
   // Lock
   static std::mutex global_mt;
+  // Wakes up the worker when an earlier deadline gets scheduled
+  static std::condition_variable cv;
+  // Notified after every callback invocation
+  static std::condition_variable callback_done_cv;
   // Thread handle
   static std::thread th;
-  // List of callbacks
-  static std::vector<std::function<void(void)>> callbacks;
+  // Registered callbacks
+  static std::unordered_map<callback_id, Entry> callbacks;
+  // Min-heap of the pending deadlines
+  static std::priority_queue<Deadline, std::vector<Deadline>,
+                             std::greater<Deadline>>
+      deadlines;
+  // Identifier for the next registered callback
+  static callback_id next_id;
+  // Identifier of the callback that is being invoked, 0 if none
+  static callback_id running_id;
   // Start/stop toggle
   static bool run;
-  // Next delay between the invokations
-  static std::chrono::milliseconds delay;
 
   // The thread worker responsible for invoking the callbaks
   static void Worker();
 
+  // Adds a deadline for a callback, unless it already has an earlier one
+  // Expects global_mt to be locked
+  static void AddDeadline(Entry& entry, callback_id id,
+                          sync_clock::time_point deadline);
+
  public:
   // Start the callback invokation
   static void Start();
   // Stop the callback invokation
   static void Stop();
   // Register a sync callback
-  static void RegisterCallback(std::function<void(void)> cb);
+  // The callback isn't invoked until it's scheduled
+  static callback_id RegisterCallback(sync_callback cb);
+  // Unregister a sync callback
+  // Waits for an in-flight invocation to finish, unless called from within the
+  // callback itself
+  static void UnregisterCallback(callback_id id);
+  // Schedule the callback to be invoked no later than the deadline
+  static void Schedule(callback_id id, sync_clock::time_point deadline);
 };
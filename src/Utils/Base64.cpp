@@ -0,0 +1,98 @@
+#include "Base64.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_HAS_SSSE3 1
+#endif
+
+// Unnamed namespace for local utilities
+namespace {
+constexpr char alphabet[] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Encodes the input in full 3 byte groups and pads the last one
+void EncodeScalar(const unsigned char* data, size_t length, char* out) {
+  size_t i = 0;
+  for (; i + 3 <= length; i += 3) {
+    const unsigned int group =
+        (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+    *out++ = alphabet[(group >> 18) & 0x3F];
+    *out++ = alphabet[(group >> 12) & 0x3F];
+    *out++ = alphabet[(group >> 6) & 0x3F];
+    *out++ = alphabet[group & 0x3F];
+  }
+
+  const size_t remaining = length - i;
+  if (remaining == 0) {
+    return;
+  }
+
+  const unsigned int group =
+      (data[i] << 16) | (remaining == 2 ? data[i + 1] << 8 : 0);
+  *out++ = alphabet[(group >> 18) & 0x3F];
+  *out++ = alphabet[(group >> 12) & 0x3F];
+  *out++ = remaining == 2 ? alphabet[(group >> 6) & 0x3F] : '=';
+  *out++ = '=';
+}
+
+#ifdef BASE64_HAS_SSSE3
+// Encodes 12 input bytes into 16 characters per iteration, based on Wojciech
+// Muła's pshufb algorithm
+// Every iteration loads 16 bytes, so the last few groups are left for the
+// scalar encoder
+// Returns the amount of encoded input bytes
+__attribute__((target("ssse3"))) size_t EncodeSSSE3(const unsigned char* data,
+                                                     size_t length,
+                                                     char* out) {
+  // Spreads every 3 byte group into a 4 byte lane
+  const __m128i spread =
+      _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  // Offsets from the 6-bit values to their characters, by value range
+  const __m128i offsets = _mm_setr_epi8(
+      'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+      '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0);
+
+  size_t i = 0;
+  for (; i + 16 <= length; i += 12) {
+    __m128i input =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    input = _mm_shuffle_epi8(input, spread);
+
+    // Move the four 6-bit values of every lane into separate bytes
+    const __m128i high = _mm_mulhi_epu16(
+        _mm_and_si128(input, _mm_set1_epi32(0x0FC0FC00)),
+        _mm_set1_epi32(0x04000040));
+    const __m128i low = _mm_mullo_epi16(
+        _mm_and_si128(input, _mm_set1_epi32(0x003F03F0)),
+        _mm_set1_epi32(0x01000010));
+    const __m128i values = _mm_or_si128(high, low);
+
+    // Map the values to their index in the offsets: 13 for 0-25 (A-Z), 0 for
+    // 26-51 (a-z), 1-10 for the digits, 11 for '+' and 12 for '/'
+    __m128i ranges = _mm_subs_epu8(values, _mm_set1_epi8(51));
+    const __m128i is_upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+    ranges = _mm_or_si128(ranges, _mm_and_si128(is_upper, _mm_set1_epi8(13)));
+
+    const __m128i chars =
+        _mm_add_epi8(_mm_shuffle_epi8(offsets, ranges), values);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), chars);
+    out += 16;
+  }
+
+  return i;
+}
+#endif
+}  // namespace
+
+void Base64Encode(const unsigned char* data, size_t length, char* out) {
+  size_t encoded = 0;
+
+#ifdef BASE64_HAS_SSSE3
+  static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+  if (has_ssse3) {
+    encoded = EncodeSSSE3(data, length, out);
+  }
+#endif
+
+  EncodeScalar(data + encoded, length - encoded, out + encoded / 3 * 4);
+}
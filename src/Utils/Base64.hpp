@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+
+// Length of the padded base64 encoding of the specified amount of bytes
+constexpr size_t Base64EncodedLength(size_t length) {
+  return (length + 2) / 3 * 4;
+}
+
+// Encodes the bytes into base64 with padding
+// The output needs room for Base64EncodedLength(length) characters, no null
+// terminator is written
+// Uses SSSE3 when the CPU supports it
+void Base64Encode(const unsigned char* data, size_t length, char* out);
@@ -1,66 +1,222 @@
 #include "CommandProcessor.hpp"
 
+// The fallback decodes at the rate and channel count the encoder expects
+constexpr int fallback_decode_rate = 16000;
+constexpr int fallback_decode_channels = 1;
+// Format of the command PCM audio
+constexpr int streaming_rate = 16000;
+constexpr int streaming_channels = 1;
+
+// Unnamed namespace for local utilities
+namespace {
+// Outcome of the recognition shown in the trace
+const char* GetTraceStatus(CommandStatus status) {
+  switch (status) {
+    case CommandStatus::Empty:
+      return "empty";
+    case CommandStatus::Error:
+      return "error";
+    case CommandStatus::Ok:
+    default:
+      return "ok";
+  }
+}
+}  // namespace
+
 CommandProcessor::CommandProcessor(
-    AppConfig config, const std::shared_ptr<ThreadPool>& pool,
-    std::function<void(std::string&)> data_callback)
-    : pool(pool), is_done(false) {
+    AppConfig config, Executor& pool,
+    const std::shared_ptr<Recognizer>& recognizer, Tracer::trace_id trace_id,
+    std::function<void(CommandResult&)> data_callback)
+    : recognizer(recognizer),
+      strand(pool),
+      is_done(false),
+      trace_id(trace_id),
+      hotword_timestamp(Metrics::clock::now()) {
   this->config = std::move(config);
   this->data_callback = std::move(data_callback);
+
+  // Encode the PCM frames in OggOpus format as they arrive
+  // The passthrough mode keeps the original packets instead, while the
+  // streaming recognizer sends the PCM frames as they are
+  if (this->config.streaming_recognizer_url.empty() &&
+      this->config.command_audio_mode == CommandAudioMode::Reencode) {
+    CreateEncoder();
+  }
 };
 
-// Add audio to the storage buffer
-void CommandProcessor::AddAudio(std::vector<pcm_frame>& frames) {
-  command_pcm_frames.insert(command_pcm_frames.end(), frames.begin(),
-                            frames.end());
+// Add audio to the command, encoding it right away
+void CommandProcessor::AddAudio(const PCMChunkPool::chunk& frames) {
+  // The encoding is bulk work, so it's moved off the caller's realtime worker
+  // The task references the chunk until it's encoded
+  strand.Post([this, self = shared_from_this(), frames]() {
+    std::lock_guard<std::mutex> lck(mt);
+
+    if (config.streaming_recognizer_url.empty()) {
+      // Commands of PCM streams get encoded in the passthrough mode as well
+      if (!encoder) {
+        CreateEncoder();
+      }
+      const auto encode_start = Metrics::clock::now();
+      encoder->Write(frames->Data(), frames->Size());
+      encode_time += Metrics::clock::now() - encode_start;
+    } else {
+      GetStreamingRecognizer().Write(frames);
+    }
+    command_sample_count += frames->Size();
+
+    SPDLOG_DEBUG(
+        "CommandProcessor::AddAudio : New frames: {}, current command size is "
+        "{}.",
+        frames->Size(), command_sample_count);
+  });
+}
+
+void CommandProcessor::AddPackets(const OpusPacketBuffer& packets,
+                                  size_t first) {
+  std::lock_guard<std::mutex> lck(mt);
+
+  command_packets.Append(packets, first);
 
   SPDLOG_DEBUG(
-      "CommandProcessor::AddAudio : New frames: {}, current buffer size is {}.",
-      frames.size(), command_pcm_frames.size());
+      "CommandProcessor::AddPackets : New packets: {}, current command size is "
+      "{} packets.",
+      packets.Size() - std::min(first, packets.Size()),
+      command_packets.Size());
 }
 
 void CommandProcessor::StartProcessing() {
-  // Enqueue a task for the threadpool
-  pool->enqueue([this]() {
-    std::function<void(std::vector<unsigned char>&)> cb =
-        [this](std::vector<unsigned char>& encoded_ogg_opus) {
-          GSpeechToText parser(this->config.g_speech_to_text_api_key);
-
-          SPDLOG_INFO(
-              "CommandProcessor::StartProcessing::encoded_ogg_opus_cb : "
-              "encoded_ogg_opus size is {}.",
-              encoded_ogg_opus.size());
-
-          // Invoke speech to text parsing
-          auto json_data = parser.GetTextFromOggOpus(encoded_ogg_opus);
-
-          // Parse the output and select the most likely correct result
-          auto parsed_data = nlohmann::json::parse(json_data);
-          std::string data =
-              parsed_data["results"][0]["alternatives"][0]["transcript"];
-
-          SPDLOG_INFO(
-              "CommandProcessor::StartProcessing::encoded_ogg_opus_cb : "
-              "Finished "
-              "parsing speech.");
-
-          SPDLOG_DEBUG(
-              "CommandProcessor::StartProcessing::encoded_ogg_opus_cb : Text "
-              "data "
-              "is: {}",
-              data);
-
-          // Callback VoiceProcessor
-          this->data_callback(data);
-
-          // Set as done for later cleanup
-          this->is_done = true;
-        };
-
-    // Encode the PCM frames in OggOpus format
-    // Callback for further processing
-    OpusOggEncoder encoder(cb);
-    encoder.Encode(this->command_pcm_frames);
+  end_timestamp = Metrics::clock::now();
+
+  // Queued behind the audio that is still being encoded
+  strand.Post([this, self = shared_from_this()]() {
+    std::lock_guard<std::mutex> lck(mt);
+
+    finish_start_timestamp = Metrics::clock::now();
+    Tracer::RecordSpan(trace_id, "queueWait", end_timestamp,
+                       finish_start_timestamp);
+
+    // The streaming recognizer already has the audio, so it only needs to know
+    // that the command ended
+    if (!config.streaming_recognizer_url.empty()) {
+      recognition_start_timestamp = finish_start_timestamp;
+      GetStreamingRecognizer().Finish();
+      return;
+    }
+
+    // Only the last page is left to encode at this point
+    // The encoding time stops once the recognition starts
+    if (config.command_audio_mode == CommandAudioMode::Passthrough &&
+        !encoder) {
+      FinishPassthrough();
+    } else {
+      encoder->Finish();
+    }
   });
 }
 
+void CommandProcessor::CreateEncoder() {
+  // Callback for further processing once the encoding is finished
+  encoder = std::make_unique<OpusOggEncoder>(
+      [this](EncodedAudio& audio) { RecognizeAudio(audio); });
+}
+
+StreamingRecognizer& CommandProcessor::GetStreamingRecognizer() {
+  // Only called with a lock acquired
+  // The callback keeps this instance alive until the final result
+  if (!streaming_recognizer) {
+    streaming_recognizer = StreamingRecognizer::Create(
+        config.streaming_recognizer_url, streaming_rate, streaming_channels,
+        [this, self = shared_from_this()](CommandResult& result) {
+          DeliverResult(result);
+        });
+  }
+
+  return *streaming_recognizer;
+}
+
+void CommandProcessor::FinishPassthrough() {
+  if (OggOpusMuxer::CanMux(command_packets)) {
+    auto audio = OggOpusMuxer::Mux(command_packets);
+    RecognizeAudio(audio);
+    return;
+  }
+
+  SPDLOG_WARN(
+      "CommandProcessor::FinishPassthrough : {} packets can't be muxed, "
+      "re-encoding them instead.",
+      command_packets.Size());
+
+  // Decode with a fresh decoder, the packets were already decoded once by the
+  // stream's own one
+  OpusFrameDecoder fallback_decoder(fallback_decode_rate,
+                                    fallback_decode_channels);
+  std::vector<pcm_frame> frames;
+  fallback_decoder.Decode(command_packets, frames);
+
+  CreateEncoder();
+  encoder->Write(frames.data(), frames.size());
+  encoder->Finish();
+}
+
+void CommandProcessor::RecognizeAudio(EncodedAudio& audio) {
+  SPDLOG_INFO(
+      "CommandProcessor::RecognizeAudio : encoded audio size is {}, sample "
+      "rate is {}, trace ID:{}.",
+      audio.data.size(), audio.sample_rate, trace_id);
+
+  recognition_start_timestamp = Metrics::clock::now();
+  encode_time += recognition_start_timestamp - finish_start_timestamp;
+  Metrics::Record(Metrics::Stage::CommandEncode, encode_time);
+  Tracer::RecordSpan(trace_id, "encode", finish_start_timestamp,
+                     recognition_start_timestamp);
+
+  // The callback keeps this instance alive until the result arrives
+  // The audio isn't needed afterwards, so it's handed over to the upload
+  recognizer->Recognize(
+      std::move(audio),
+      [this, self = shared_from_this()](CommandResult& result) {
+        SPDLOG_INFO(
+            "CommandProcessor::RecognizeAudio : Finished parsing speech.");
+        DeliverResult(result);
+      });
+}
+
+void CommandProcessor::DeliverResult(CommandResult& result) {
+  result.trace_id = trace_id;
+
+  if (!result.is_final) {
+    data_callback(result);
+    return;
+  }
+
+  // Final results without any text are reported as such, regardless of the
+  // recognizer
+  if (result.status == CommandStatus::Ok && result.transcript.empty()) {
+    result.status = CommandStatus::Empty;
+  }
+
+  const auto current_time = Metrics::clock::now();
+  if (recognition_start_timestamp != Metrics::clock::time_point()) {
+    Metrics::Record(Metrics::Stage::RecognizerRoundTrip,
+                    current_time - recognition_start_timestamp);
+    Tracer::RecordSpan(trace_id, "recognize", recognition_start_timestamp,
+                       current_time, GetTraceStatus(result.status));
+  }
+  Metrics::Record(Metrics::Stage::HotwordToCallback,
+                  current_time - hotword_timestamp);
+  Metrics::Increment(Metrics::Counter::CommandsCompleted);
+  if (result.status == CommandStatus::Error) {
+    Metrics::Increment(Metrics::Counter::CommandErrors);
+  }
+
+  // Callback VoiceProcessor
+  // The callback is released afterwards, since it keeps the VoiceProcessor
+  // that owns this instance alive
+  auto callback = std::move(data_callback);
+  callback(result);
+
+  // Set as done for later cleanup
+  is_done = true;
+}
+
 bool CommandProcessor::GetStatus() { return is_done; };
@@ -1,26 +1,42 @@
 #pragma once
 
-#include <ThreadPool.h>
-#include <base64.h>
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
+#include <algorithm>
 #include <atomic>
 #include <functional>
-#include <nlohmann/json.hpp>
+#include <memory>
 #include <string>
 #include <vector>
-#include "../APIs/GSpeechToText.hpp"
+#include "../APIs/StreamingRecognizer.hpp"
+#include "../Buffers/OpusPacketBuffer.hpp"
+#include "../Buffers/PCMChunkPool.hpp"
+#include "../Codecs/OggOpusMuxer.hpp"
+#include "../Codecs/OpusDecoder.hpp"
 #include "../Codecs/OpusOggEncoder.hpp"
 #include "../Config/AppConfig.hpp"
+#include "../Executor/Executor.hpp"
+#include "../Executor/Strand.hpp"
+#include "../Metrics/Metrics.hpp"
+#include "../Metrics/Tracer.hpp"
+#include "../Recognizers/Recognizer.hpp"
 #include "../types.h"
 
 // Stores the command releted audio and transforms it into a text command
-class CommandProcessor {
+class CommandProcessor
+    : public std::enable_shared_from_this<CommandProcessor> {
  public:
-  CommandProcessor(AppConfig config, const std::shared_ptr<ThreadPool>& pool,
-                   std::function<void(std::string&)> data_callback);
-  // Add audio to the storage buffer
-  void AddAudio(std::vector<pcm_frame>& frames);
+  // The trace ID identifies the command in the trace and in its results
+  CommandProcessor(AppConfig config, Executor& pool,
+                   const std::shared_ptr<Recognizer>& recognizer,
+                   Tracer::trace_id trace_id,
+                   std::function<void(CommandResult&)> data_callback);
+  // Add audio to the command, encoding it on the bulk executor right away
+  // The streaming recognizer keeps a reference to the chunk until it's sent
+  void AddAudio(const PCMChunkPool::chunk& frames);
+  // Add original OPUS packets to the command, starting with the specified one
+  // Used instead of AddAudio in the passthrough mode
+  void AddPackets(const OpusPacketBuffer& packets, size_t first = 0);
 
   // Start the speech to text conversion
   void StartProcessing();
@@ -28,21 +44,53 @@ class CommandProcessor {
   // Fetches the completion status
   bool GetStatus();
 
+  Tracer::trace_id GetTraceId() const { return trace_id; }
+
  private:
-  // PCM buffer for the audio segment storage
-  std::vector<pcm_frame> command_pcm_frames;
+  // Encodes the command audio as it's added
+  std::unique_ptr<OpusOggEncoder> encoder;
+  // Streams the command audio as it's added, if a streaming server is set
+  std::shared_ptr<StreamingRecognizer> streaming_recognizer;
+  // Recognizes the encoded command audio otherwise
+  std::shared_ptr<Recognizer> recognizer;
+  // Amount of added audio samples
+  size_t command_sample_count = 0;
+  // Original OPUS packets of the command in the passthrough mode
+  OpusPacketBuffer command_packets;
 
   // Application wide configuration
   AppConfig config;
 
   // Callback for when the text data is ready
-  std::function<void(std::string&)> data_callback;
+  // Invoked for every interim result and once for the final one
+  std::function<void(CommandResult&)> data_callback;
 
-  // Thread pool
-  std::shared_ptr<ThreadPool> pool;
+  // Runs the encoding and the finishing in order on the bulk executor
+  Strand strand;
 
   // Lock
   std::mutex mt;
   // Completion status
   std::atomic<bool> is_done;
+
+  // Timing of the command stages
+  // The command is created when its hotword is detected
+  Tracer::trace_id trace_id;
+  Metrics::clock::time_point hotword_timestamp;
+  Metrics::clock::time_point end_timestamp;
+  Metrics::clock::duration encode_time = Metrics::clock::duration::zero();
+  Metrics::clock::time_point finish_start_timestamp;
+  // Set when the recognition of the whole command starts
+  Metrics::clock::time_point recognition_start_timestamp;
+
+  // Creates the encoder that passes its output to RecognizeAudio
+  void CreateEncoder();
+  // Starts the streaming transfer on first use
+  StreamingRecognizer& GetStreamingRecognizer();
+  // Passes a result to the callback, releasing it after the final one
+  void DeliverResult(CommandResult& result);
+  // Muxes the original packets, or re-encodes them if they can't be muxed
+  void FinishPassthrough();
+  // Converts the encoded command audio to text and invokes the callback
+  void RecognizeAudio(EncodedAudio& audio);
 };
@@ -1,61 +1,78 @@
 #include "HotwordDetector.hpp"
+#include <algorithm>
+
+// Sample rate of the audio Porcupine expects
+constexpr int pv_sample_rate = 16000;
 
 HotwordDetector::HotwordDetector(
-    std::string& keyword_path, std::string& model_path, float sensitivity,
-    std::function<void(std::vector<pcm_frame>&)> callback) {
+    std::string keyword_path, std::string model_path, float sensitivity,
+    int max_backlog_ms, std::function<void(std::vector<pcm_frame>&)> callback)
+    : pv_frame_buffer_size(pv_porcupine_frame_length()),
+      keyword_path(std::move(keyword_path)),
+      model_path(std::move(model_path)),
+      sensitivity(sensitivity),
+      buffer(pv_frame_buffer_size,
+             std::max<size_t>(1, (static_cast<size_t>(max_backlog_ms) *
+                                      pv_sample_rate / 1000 +
+                                  pv_frame_buffer_size - 1) /
+                                     pv_frame_buffer_size)) {
   this->callback = std::move(callback);
-  SPDLOG_INFO("Initializing porcupine hotword detector.");
-
-  SPDLOG_INFO(
-      "Sensitivity: {}, keyword "
-      "path: {}, model path: {}.",
-      sensitivity, keyword_path, model_path);
-
-  // Initialize Porcupine and gather the buffer parsing settings
-  pv_status_t status = pv_porcupine_init(
-      model_path.c_str(), keyword_path.c_str(), sensitivity, &porcupine_object);
-  if (status != PV_STATUS_SUCCESS) {
-    SPDLOG_ERROR("Failed to initialize Porcupine.");
-  }
-
-  pv_frame_buffer_size = pv_porcupine_frame_length();
 };
 
-HotwordDetector::~HotwordDetector() { pv_porcupine_delete(porcupine_object); }
+bool HotwordDetector::Check(const pcm_frame* pcm_data, size_t size) {
+  // Lease a Porcupine handle on the first check
+  if (!porcupine_object) {
+    porcupine_object =
+        PorcupinePool::Acquire(model_path, keyword_path, sensitivity);
+    // The pool logs the failures and backs off the retries, so the checks
+    // meanwhile don't touch the disk
+    if (!porcupine_object) {
+      SPDLOG_DEBUG(
+          "HotwordDetector::Check : No Porcupine handle available. Skipping "
+          "{} frames.",
+          size);
+      return false;
+    }
+  }
 
-void HotwordDetector::Check(std::vector<pcm_frame> pcm_data) {
-  // Prevent concurrent checks
-  std::lock_guard<std::mutex> lck(mt);
   // Add to the main buffer in case there are any leftover frames
-  buffer.insert(buffer.end(), pcm_data.begin(), pcm_data.end());
+  auto skipped_frames = buffer.Write(pcm_data, size);
+  if (skipped_frames > 0) {
+    SPDLOG_WARN(
+        "HotwordDetector::Check : Backlog limit reached. Skipped {} Porcupine "
+        "frames.",
+        skipped_frames);
+  }
 
   SPDLOG_DEBUG("HotwordDetector::Check : In progress. pcm_data size: {}.",
-               pcm_data.size());
+               size);
   bool detected = false;
 
-  // Check frames in batches according to pv_frame_buffer_size
-  while (!detected && buffer.size() > pv_frame_buffer_size) {
-    pv_porcupine_process(porcupine_object, &buffer[0], &detected);
+  // Check the complete Porcupine frames in place
+  while (!detected && !buffer.Empty()) {
+    pv_porcupine_process(porcupine_object.get(), buffer.Front(), &detected);
 
     if (detected) {
       SPDLOG_INFO(
           "HotwordDetector::Check : Keyword detected. Remaining buffer "
-          "size: {}.",
-          buffer.size());
+          "frames: {}.",
+          buffer.Size());
 
       // Once a hotword is detected, submit the remaining audio data to the
       // callback
-      auto leftover_buffer = buffer;
-      buffer.clear();
+      std::vector<pcm_frame> leftover_buffer;
+      buffer.DrainInto(leftover_buffer);
       this->callback(leftover_buffer);
     } else {
       // Remove the already checked audio data from the buffer
-      buffer.erase(buffer.begin(), buffer.begin() + pv_frame_buffer_size);
+      buffer.Pop();
 
-      SPDLOG_DEBUG(
+      SPDLOG_TRACE(
           "HotwordDetector::Check : No keyword detected. Remaining buffer "
-          "size: {}.",
-          buffer.size());
+          "frames: {}.",
+          buffer.Size());
     }
   }
+
+  return detected;
 }
@@ -1,41 +1,50 @@
 #pragma once
 
-#include <ThreadPool.h>
 #include <picovoice.h>
 #include <pv_porcupine.h>
 #include <spdlog/spdlog.h>
 #include <chrono>
 #include <functional>
-#include <mutex>
 #include <string>
 #include <vector>
+#include "../Buffers/PCMFrameRing.hpp"
 #include "../types.h"
+#include "PorcupinePool.hpp"
 
 // Processes audio and detects the hotwords
 // Needs to be VoiceProcessor specific since it holds lefotover buffers
+// Not thread safe, the checks run on the stream's strand
+// The Porcupine handle is leased from the PorcupinePool on the first check, so
+// that the construction is cheap and a handle that has to be initialized is
+// loaded on a worker thread instead of the main thread
 class HotwordDetector {
  public:
-  HotwordDetector(std::string& keyword_path, std::string& model_path,
-                  float sensitivity,
+  HotwordDetector(std::string keyword_path, std::string model_path,
+                  float sensitivity, int max_backlog_ms,
                   std::function<void(std::vector<pcm_frame>&)> callback);
   HotwordDetector(const HotwordDetector&) = delete;
   HotwordDetector(const HotwordDetector&&) = delete;
-  ~HotwordDetector();
 
   // Checks the data for hotwords
-  void Check(std::vector<pcm_frame> pcm_data);
+  // Returns whether one was detected, the audio after it is passed to the
+  // callback instead of being checked
+  bool Check(const pcm_frame* pcm_data, size_t size);
 
  private:
   // Porcupine handles/data
-  pv_porcupine_object_t* porcupine_object = nullptr;
+  PorcupinePool::handle porcupine_object;
   size_t pv_frame_buffer_size;
 
+  // Porcupine settings
+  std::string keyword_path;
+  std::string model_path;
+  float sensitivity;
+
   // Invoked on hotword detection
   std::function<void(std::vector<pcm_frame>&)> callback;
 
   // Buffer to store the PCM data and leftovers in
-  std::vector<pcm_frame> buffer;
-
-  // Prevent access by multiple threads
-  std::mutex mt;
+  // Holds up to the max backlog, older audio is skipped when workers fall
+  // behind
+  PCMFrameRing buffer;
 };
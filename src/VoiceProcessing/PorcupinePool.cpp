@@ -0,0 +1,143 @@
+#include "PorcupinePool.hpp"
+
+// Porcupine audio format
+constexpr int pv_sample_rate = 16000;
+// Amount of silence that clears the detection state of a released handle
+constexpr int flush_ms = 1000;
+// Delay before a failed initialization is retried
+constexpr std::chrono::seconds init_retry_interval(10);
+
+std::mutex PorcupinePool::global_mt;
+std::unordered_map<std::string, std::vector<PorcupinePool::IdleHandle>>
+    PorcupinePool::idle_handles;
+std::unordered_map<std::string, PorcupinePool::clock::time_point>
+    PorcupinePool::retry_timestamps;
+
+std::string PorcupinePool::GetKey(const std::string& model_path,
+                                  const std::string& keyword_path,
+                                  float sensitivity) {
+  return model_path + '\n' + keyword_path + '\n' + std::to_string(sensitivity);
+}
+
+pv_porcupine_object_t* PorcupinePool::CreateHandle(
+    const std::string& key, const std::string& model_path,
+    const std::string& keyword_path, float sensitivity) {
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    auto it = retry_timestamps.find(key);
+    if (it != retry_timestamps.end() && clock::now() < it->second) {
+      return nullptr;
+    }
+  }
+
+  SPDLOG_INFO("Initializing porcupine hotword detector.");
+
+  SPDLOG_INFO(
+      "Sensitivity: {}, keyword "
+      "path: {}, model path: {}.",
+      sensitivity, keyword_path, model_path);
+
+  pv_porcupine_object_t* object = nullptr;
+  pv_status_t status = pv_porcupine_init(
+      model_path.c_str(), keyword_path.c_str(), sensitivity, &object);
+
+  std::lock_guard<std::mutex> lck(global_mt);
+  if (status != PV_STATUS_SUCCESS) {
+    SPDLOG_ERROR("Failed to initialize Porcupine, retrying in {}s.",
+                 init_retry_interval.count());
+    retry_timestamps[key] = clock::now() + init_retry_interval;
+    return nullptr;
+  }
+
+  retry_timestamps.erase(key);
+  return object;
+}
+
+void PorcupinePool::Flush(pv_porcupine_object_t* object) {
+  const int frame_length = pv_porcupine_frame_length();
+  const std::vector<int16_t> silence(frame_length, 0);
+
+  bool detected = false;
+  for (int i = 0; i < flush_ms * pv_sample_rate / 1000; i += frame_length) {
+    pv_porcupine_process(object, silence.data(), &detected);
+  }
+}
+
+void PorcupinePool::Release(const std::string& key,
+                            pv_porcupine_object_t* object) {
+  // Runs on whichever thread drops the stream, so the flush is left for the
+  // next lease
+  std::lock_guard<std::mutex> lck(global_mt);
+  idle_handles[key].push_back({object, true});
+}
+
+PorcupinePool::handle PorcupinePool::Acquire(const std::string& model_path,
+                                             const std::string& keyword_path,
+                                             float sensitivity) {
+  auto key = GetKey(model_path, keyword_path, sensitivity);
+  IdleHandle idle_handle = {nullptr, false};
+
+  {
+    std::lock_guard<std::mutex> lck(global_mt);
+    auto& idle = idle_handles[key];
+    if (!idle.empty()) {
+      idle_handle = idle.back();
+      idle.pop_back();
+    }
+  }
+
+  // Porcupine can't be reset, so the audio of the previous stream is pushed
+  // out with silence, otherwise it could complete a hotword with the audio of
+  // the next one
+  // Flush and initialize outside of the lock, on the leasing worker
+  auto object = idle_handle.object;
+  if (object != nullptr && idle_handle.needs_flush) {
+    Flush(object);
+  }
+  if (object == nullptr) {
+    object = CreateHandle(key, model_path, keyword_path, sensitivity);
+    if (object == nullptr) {
+      return handle(nullptr, [](pv_porcupine_object_t*) {});
+    }
+  }
+
+  return handle(object, [key](pv_porcupine_object_t* object) {
+    PorcupinePool::Release(key, object);
+  });
+}
+
+void PorcupinePool::Prewarm(const std::string& model_path,
+                            const std::string& keyword_path,
+                            float sensitivity, size_t count) {
+  auto key = GetKey(model_path, keyword_path, sensitivity);
+
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lck(global_mt);
+      if (idle_handles[key].size() >= count) {
+        return;
+      }
+    }
+
+    auto object = CreateHandle(key, model_path, keyword_path, sensitivity);
+    if (object == nullptr) {
+      return;
+    }
+
+    // New handles don't need a flush
+    std::lock_guard<std::mutex> lck(global_mt);
+    idle_handles[key].push_back({object, false});
+  }
+}
+
+void PorcupinePool::Clear() {
+  std::lock_guard<std::mutex> lck(global_mt);
+
+  for (auto& entry : idle_handles) {
+    for (auto& idle_handle : entry.second) {
+      pv_porcupine_delete(idle_handle.object);
+    }
+  }
+  idle_handles.clear();
+  retry_timestamps.clear();
+}
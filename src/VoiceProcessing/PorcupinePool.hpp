@@ -0,0 +1,70 @@
+#pragma once
+
+#include <picovoice.h>
+#include <pv_porcupine.h>
+#include <spdlog/spdlog.h>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// A static class that keeps a process wide pool of initialized Porcupine
+// handles, so that new streams don't need to load the model and keyword files
+// from the disk again
+// Released handles are flushed when they're leased again, so that the thread
+// dropping a stream doesn't run Porcupine
+class PorcupinePool {
+ public:
+  // Leased handle, returned to the pool once destroyed
+  using handle =
+      std::unique_ptr<pv_porcupine_object_t,
+                      std::function<void(pv_porcupine_object_t*)>>;
+
+ private:
+  using clock = std::chrono::steady_clock;
+
+  // Idle handle, with whether it still holds the state of a previous stream
+  struct IdleHandle {
+    pv_porcupine_object_t* object;
+    bool needs_flush;
+  };
+
+  // Lock
+  static std::mutex global_mt;
+  // Idle handles for every model/keyword/sensitivity combination
+  static std::unordered_map<std::string, std::vector<IdleHandle>> idle_handles;
+  // Time after which a failed initialization is retried, for every
+  // combination, so that the streams don't load the files on every check
+  static std::unordered_map<std::string, clock::time_point> retry_timestamps;
+
+  // Builds the pool key for the handle settings
+  static std::string GetKey(const std::string& model_path,
+                            const std::string& keyword_path,
+                            float sensitivity);
+  // Initializes a new handle, returns nullptr on failure
+  // Failures back off the next attempts with the same settings
+  static pv_porcupine_object_t* CreateHandle(const std::string& key,
+                                             const std::string& model_path,
+                                             const std::string& keyword_path,
+                                             float sensitivity);
+  // Clears the detection state of a handle that was used by a stream
+  static void Flush(pv_porcupine_object_t* object);
+  // Returns a handle to the idle pool
+  static void Release(const std::string& key, pv_porcupine_object_t* object);
+
+ public:
+  // Leases an idle handle, or initializes a new one if there are none
+  // Returns an empty handle if Porcupine fails to initialize, or if it failed
+  // recently with the same settings
+  static handle Acquire(const std::string& model_path,
+                        const std::string& keyword_path, float sensitivity);
+  // Initializes handles ahead of time, up to the specified amount of idle ones
+  static void Prewarm(const std::string& model_path,
+                      const std::string& keyword_path, float sensitivity,
+                      size_t count);
+  // Deletes all idle handles
+  static void Clear();
+};
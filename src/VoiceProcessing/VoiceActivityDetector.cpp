@@ -0,0 +1,180 @@
+#include "VoiceActivityDetector.hpp"
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Analysis window length
+constexpr int window_ms = 20;
+// Voiced state is kept for this long after speech, so that word gaps and
+// trailing consonants aren't cut off
+constexpr int hangover_ms = 300;
+// Mean square energy below which audio is never voiced, about -50 dBFS
+constexpr double min_speech_energy = 10000;
+// Voiced windows need to be this many times louder than the noise floor
+constexpr double noise_floor_ratio = 3.0;
+// How fast the noise floor follows the unvoiced windows
+constexpr double noise_floor_adaptation = 0.05;
+// Quiet windows with more zero crossings per sample than this are noise
+constexpr double max_voiced_zcr = 0.35;
+// Windows this many times above the threshold are voiced regardless of the
+// zero crossing rate
+constexpr double loud_energy_ratio = 4.0;
+
+// Unnamed namespace for local utilities
+namespace {
+// Sum of squares and zero crossing count of a window
+struct WindowStats {
+  uint64_t energy = 0;
+  size_t zero_crossings = 0;
+};
+
+WindowStats GetWindowStats(const pcm_frame* window, size_t length) {
+  WindowStats stats;
+  size_t i = 1;
+
+  // The first sample has no predecessor within the window
+  stats.energy = static_cast<uint64_t>(window[0] * window[0]);
+
+#ifdef __SSE2__
+  const __m128i zero = _mm_setzero_si128();
+  __m128i energy = _mm_setzero_si128();
+  __m128i crossings = _mm_setzero_si128();
+
+  for (; i + 8 <= length; i += 8) {
+    const __m128i current =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + i));
+    const __m128i previous =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(window + i - 1));
+
+    // Pairwise sums of squares fit into unsigned 32-bit lanes, which are
+    // widened before accumulating
+    const __m128i squares = _mm_madd_epi16(current, current);
+    energy = _mm_add_epi64(energy, _mm_unpacklo_epi32(squares, zero));
+    energy = _mm_add_epi64(energy, _mm_unpackhi_epi32(squares, zero));
+
+    // The sign differs where the XOR of the neighbours is negative
+    // Lanes count the matches as -1, so they're subtracted
+    const __m128i sign_change =
+        _mm_cmplt_epi16(_mm_xor_si128(current, previous), zero);
+    crossings = _mm_sub_epi16(crossings, sign_change);
+  }
+
+  alignas(16) uint64_t energy_lanes[2];
+  _mm_store_si128(reinterpret_cast<__m128i*>(energy_lanes), energy);
+  stats.energy += energy_lanes[0] + energy_lanes[1];
+
+  alignas(16) uint16_t crossing_lanes[8];
+  _mm_store_si128(reinterpret_cast<__m128i*>(crossing_lanes), crossings);
+  for (auto lane : crossing_lanes) {
+    stats.zero_crossings += lane;
+  }
+#endif
+
+  for (; i < length; i++) {
+    stats.energy += static_cast<uint64_t>(window[i] * window[i]);
+    stats.zero_crossings += (window[i] ^ window[i - 1]) < 0 ? 1 : 0;
+  }
+
+  return stats;
+}
+}  // namespace
+
+VoiceActivityDetector::VoiceActivityDetector(int sample_rate)
+    : sample_rate(sample_rate),
+      window_length(static_cast<size_t>(sample_rate) * window_ms / 1000),
+      hangover_windows(hangover_ms / window_ms),
+      noise_floor(min_speech_energy / noise_floor_ratio),
+      unvoiced_windows(hangover_windows) {
+  partial_window.reserve(window_length);
+}
+
+bool VoiceActivityDetector::Process(const pcm_frame* frames, size_t count) {
+  bool voiced = false;
+  bool classified = false;
+
+  // Complete the window left over from the previous call
+  if (!partial_window.empty()) {
+    const size_t missing =
+        std::min(window_length - partial_window.size(), count);
+    partial_window.insert(partial_window.end(), frames, frames + missing);
+    frames += missing;
+    count -= missing;
+
+    // Too short to classify, keep the current state
+    if (partial_window.size() < window_length) {
+      return IsInVoicedState();
+    }
+
+    voiced |= OnWindow(IsVoiced(partial_window.data()));
+    classified = true;
+    partial_window.clear();
+  }
+
+  for (; count >= window_length; count -= window_length) {
+    voiced |= OnWindow(IsVoiced(frames));
+    classified = true;
+    frames += window_length;
+  }
+
+  partial_window.assign(frames, frames + count);
+  return classified ? voiced : IsInVoicedState();
+}
+
+void VoiceActivityDetector::AddSilence(size_t sample_count) {
+  // Incomplete windows still count towards the silence
+  partial_silence_samples += sample_count;
+  for (; partial_silence_samples >= window_length;
+       partial_silence_samples -= window_length) {
+    OnWindow(false);
+  }
+}
+
+int VoiceActivityDetector::GetTrailingSilenceMs() const {
+  return static_cast<int>(
+      (unvoiced_windows * window_length + partial_silence_samples) * 1000 /
+      sample_rate);
+}
+
+void VoiceActivityDetector::ResetTrailingSilence() {
+  unvoiced_windows = 0;
+  partial_silence_samples = 0;
+}
+
+bool VoiceActivityDetector::IsInVoicedState() const {
+  return unvoiced_windows <= hangover_windows;
+}
+
+bool VoiceActivityDetector::IsVoiced(const pcm_frame* window) {
+  const auto stats = GetWindowStats(window, window_length);
+  const double energy = static_cast<double>(stats.energy) / window_length;
+  const double zcr = static_cast<double>(stats.zero_crossings) / window_length;
+  const double threshold =
+      std::max(min_speech_energy, noise_floor * noise_floor_ratio);
+
+  const bool voiced =
+      energy > threshold &&
+      (zcr < max_voiced_zcr || energy > threshold * loud_energy_ratio);
+
+  // Follow the noise level of the unvoiced audio, drops are followed at once
+  if (!voiced) {
+    noise_floor = energy < noise_floor
+                      ? energy
+                      : noise_floor + (energy - noise_floor) *
+                                          noise_floor_adaptation;
+  }
+
+  return voiced;
+}
+
+bool VoiceActivityDetector::OnWindow(bool voiced) {
+  if (voiced) {
+    unvoiced_windows = 0;
+    partial_silence_samples = 0;
+    return true;
+  }
+
+  unvoiced_windows++;
+  return IsInVoicedState();
+}
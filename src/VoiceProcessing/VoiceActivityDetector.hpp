@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "../types.h"
+
+// Classifies mono PCM audio as voiced or unvoiced in short windows, based on
+// the window energy relative to a tracked noise floor and on the zero crossing
+// rate
+// Keeps state between calls, so the audio of a stream needs to be passed in
+// order
+class VoiceActivityDetector {
+ public:
+  explicit VoiceActivityDetector(int sample_rate);
+
+  // Analyzes the frames that follow the previously processed ones
+  // Returns whether any of the frames are voiced, counting the hangover period
+  // that follows speech as voiced too
+  bool Process(const pcm_frame* frames, size_t count);
+
+  // Counts known silence, e.g. from skipped packets, without analyzing it
+  void AddSilence(size_t sample_count);
+
+  // Length of the unvoiced audio since the last voiced window
+  int GetTrailingSilenceMs() const;
+  // Treats the audio so far as voiced, e.g. once a hotword is detected
+  void ResetTrailingSilence();
+
+ private:
+  int sample_rate;
+  size_t window_length;
+  size_t hangover_windows;
+
+  // Samples of the incomplete window from the previous call
+  std::vector<pcm_frame> partial_window;
+
+  // Tracked background noise energy
+  double noise_floor;
+  // Unvoiced windows since the last voiced one
+  size_t unvoiced_windows;
+  // Unvoiced samples that didn't make up a complete window
+  size_t partial_silence_samples = 0;
+
+  // Whether the last window was voiced or within the hangover period
+  bool IsInVoicedState() const;
+  // Classifies a single complete window
+  bool IsVoiced(const pcm_frame* window);
+  // Registers a classified window, returns whether it counts as voiced
+  bool OnWindow(bool voiced);
+};
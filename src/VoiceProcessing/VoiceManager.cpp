@@ -5,7 +5,7 @@ VoiceManager::VoiceManager(AppConfig config, command_callback cb) {
   this->cb = std::move(cb);
 
   // Try to find the optimal worler thread amount
-  auto num_threads = std::thread::hardware_concurrency();
+  size_t num_threads = std::thread::hardware_concurrency();
   if (num_threads == 0) {
     SPDLOG_WARN(
         "std::thread::hardware_concurrency returned 0 as an answer. Defaulting "
@@ -13,38 +13,212 @@ VoiceManager::VoiceManager(AppConfig config, command_callback cb) {
     num_threads = 4;
   }
 
-  // Create a thread pool
-  pool = std::make_shared<ThreadPool>(num_threads);
-  SPDLOG_INFO("Detector started with {} worker threads.", num_threads);
+  const size_t realtime_threads = this->config.realtime_threads > 0
+                                      ? this->config.realtime_threads
+                                      : num_threads;
+  const size_t bulk_threads = this->config.bulk_threads > 0
+                                  ? this->config.bulk_threads
+                                  : std::max<size_t>(1, num_threads / 4);
+
+  // Create the executors
+  realtime_pool = std::make_unique<Executor>("realtime", realtime_threads);
+  bulk_pool = std::make_unique<Executor>("bulk", bulk_threads);
+  SPDLOG_INFO(
+      "Detector started with {} realtime and {} bulk worker threads.",
+      realtime_threads, bulk_threads);
 
   // Initialize CURL here, since otherwise we'll have thread safety issues
   curl_global_init(CURL_GLOBAL_DEFAULT);
 
+  // Start the HTTP I/O thread
+  HTTPClient::Start(this->config.http_connect_timeout_ms,
+                    this->config.http_timeout_ms);
+
+  recognizer = Recognizer::Create(this->config);
+
   // Start the sync thread
   Ticker::Start();
+
+  if (!this->config.trace_path.empty()) {
+    Tracer::Start(this->config.trace_path);
+  }
+
+  // Initialize the Porcupine handles in the background, so that the first
+  // streams don't have to wait for them
+  if (this->config.pv_prewarm_count > 0) {
+    bulk_pool->Post([config = this->config]() {
+      PorcupinePool::Prewarm(config.pv_model_path, config.pv_keyword_path,
+                             config.pv_sensitivity, config.pv_prewarm_count);
+    });
+  }
+
+  // Sweep the idle streams on the sync thread, so that they get evicted even
+  // when no audio arrives
+  if (this->config.stream_idle_ttl_ms > 0) {
+    eviction_id = Ticker::RegisterCallback([this]() {
+      return EvictIdleStreams();
+    });
+    Ticker::Schedule(eviction_id,
+                     sync_clock::now() + std::chrono::milliseconds(
+                                             this->config.stream_idle_ttl_ms));
+  }
 }
 
 VoiceManager::~VoiceManager() {
-  // Cleanup CURL
+  // Stop the eviction first, it waits for a sweep that is in progress
+  if (eviction_id) {
+    Ticker::UnregisterCallback(eviction_id);
+  }
+
+  // Stop processing all the streams
+  for (auto& entry : vp_map) {
+    entry.second->Close();
+  }
+  vp_map.clear();
+
+  // Run the queued stream and command tasks and join the workers here, so
+  // that the executors are never destroyed by a task on their own worker
+  // The stream tasks can still post command work, so they go first
+  realtime_pool->Shutdown();
+  bulk_pool->Shutdown();
+
+  // Free the idle Porcupine handles
+  PorcupinePool::Clear();
+
+  // Cleanup CURL, the requests, including the streaming transfers, and pooled
+  // handles go first since they use the shared data
+  HTTPClient::Stop();
+  HTTPClient::Clear();
   curl_global_cleanup();
 
   // Stop the sync thread
   Ticker::Stop();
+
+  // The commands that are still being recognized are left out of the trace
+  if (!config.trace_path.empty()) {
+    Tracer::Stop();
+  }
+
+  // Free the idle PCM chunks, the ones still in use get freed on release
+  PCMChunkPool::Clear();
+
+  LogQueueWaitStats(*realtime_pool);
+  LogQueueWaitStats(*bulk_pool);
+}
+
+IngestStatus VoiceManager::AddOpusFrame(const std::string& id,
+                                        const opus_byte* data, size_t length) {
+  return GetVoiceProcessor(id)->AddOpusFrame(data, length);
 }
 
-void VoiceManager::AddOpusFrame(const std::string& id,
-                                const opus_frame& frame) {
+IngestStatus VoiceManager::AddOpusFrames(const std::string& id,
+                                         const opus_byte* data,
+                                         const uint32_t* lengths,
+                                         size_t count) {
+  return GetVoiceProcessor(id)->AddOpusFrames(data, lengths, count);
+}
+
+IngestStatus VoiceManager::AddPCMFrames(const std::string& id,
+                                        const pcm_frame* data,
+                                        size_t sample_count, int sample_rate,
+                                        int channels) {
+  return GetVoiceProcessor(id)->AddPCMFrames(data, sample_count, sample_rate,
+                                             channels);
+}
+
+bool VoiceManager::RemoveStream(const std::string& id) {
+  std::shared_ptr<VoiceProcessor> vp;
+  {
+    std::lock_guard<std::mutex> lk(vp_map_mt);
+    auto it = vp_map.find(id);
+    if (it == vp_map.end()) {
+      return false;
+    }
+    vp = std::move(it->second);
+    vp_map.erase(it);
+  }
+
+  SPDLOG_INFO("VoiceManager::RemoveStream : Removing stream ID:{}.", id);
+
+  vp->Close();
+  return true;
+}
+
+VoiceManager::Stats VoiceManager::GetStats() const {
+  Stats stats;
+  {
+    std::lock_guard<std::mutex> lk(vp_map_mt);
+    stats.stream_count = vp_map.size();
+  }
+  stats.backlog_ms = VoiceProcessor::GetTotalBacklogMs();
+  stats.realtime_queue_depth = realtime_pool->GetQueueDepth();
+  stats.bulk_queue_depth = bulk_pool->GetQueueDepth();
+  stats.realtime_queue_wait = realtime_pool->GetQueueWaitStats();
+  stats.bulk_queue_wait = bulk_pool->GetQueueWaitStats();
+  return stats;
+}
+
+sync_clock::time_point VoiceManager::EvictIdleStreams() {
+  const auto current_time = sync_clock::now();
+  const auto idle_ttl = std::chrono::milliseconds(config.stream_idle_ttl_ms);
+
+  // Close the streams outside of the lock, so that the audio of the others
+  // doesn't wait for it
+  std::vector<std::shared_ptr<VoiceProcessor>> evicted;
+  {
+    std::lock_guard<std::mutex> lk(vp_map_mt);
+    for (auto it = vp_map.begin(); it != vp_map.end();) {
+      if (it->second->IsIdle(current_time, idle_ttl)) {
+        SPDLOG_INFO(
+            "VoiceManager::EvictIdleStreams : Evicting idle stream ID:{}.",
+            it->first);
+        evicted.push_back(std::move(it->second));
+        it = vp_map.erase(it);
+      } else {
+        it++;
+      }
+    }
+  }
+
+  for (auto& vp : evicted) {
+    vp->Close();
+  }
+
+  return current_time + idle_ttl;
+}
+
+std::shared_ptr<VoiceProcessor> VoiceManager::GetVoiceProcessor(
+    const std::string& id) {
+  // The stream is returned by value, since the eviction can remove it from the
+  // map while its audio is being added
+  std::lock_guard<std::mutex> lk(vp_map_mt);
+
   // Try to find an existing VoiceProcessor via an ID from a Hash Map
-  if (vp_map.find(id) == vp_map.end()) {
-    // If not found, create a new one
-    auto vp = std::make_shared<VoiceProcessor>(id, config, pool, cb);
-    vp->AddOpusFrame(frame);
-
-    // Assign to the HashMap for the future reuse
-    vp_map[id] = vp;
-  } else {
-    // Find an existing VoiceProcesor and push the new OPUS frames
-    auto vp = vp_map[id];
-    vp->AddOpusFrame(frame);
+  auto it = vp_map.find(id);
+  if (it != vp_map.end()) {
+    return it->second;
   }
+
+  // If not found, create a new one and assign to the HashMap for the future
+  // reuse
+  auto vp = VoiceProcessor::Create(id, config, *realtime_pool, *bulk_pool,
+                                   recognizer, cb);
+  return vp_map.emplace(id, std::move(vp)).first->second;
+}
+
+void VoiceManager::LogQueueWaitStats(const Executor& executor) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  const auto stats = executor.GetQueueWaitStats();
+  if (stats.task_count == 0) {
+    return;
+  }
+
+  SPDLOG_INFO(
+      "VoiceManager::LogQueueWaitStats : {} executor ran {} tasks. Queue wait "
+      "average: {}us, max: {}us.",
+      executor.GetName(), stats.task_count,
+      duration_cast<microseconds>(stats.total_wait).count() / stats.task_count,
+      duration_cast<microseconds>(stats.max_wait).count());
 }
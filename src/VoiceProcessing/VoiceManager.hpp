@@ -1,34 +1,88 @@
-#include <ThreadPool.h>
 #include <curl/curl.h>
 #include <spdlog/spdlog.h>
 #include <memory>
+#include <mutex>
 #include <thread>
 #include <unordered_map>
 #include <vector>
+#include "../Buffers/PCMChunkPool.hpp"
 #include "../Config/AppConfig.hpp"
+#include "../Executor/Executor.hpp"
+#include "../Metrics/Tracer.hpp"
+#include "../Recognizers/Recognizer.hpp"
 #include "../Ticker/Ticker.hpp"
 #include "../types.h"
+#include "PorcupinePool.hpp"
 #include "VoiceProcessor.hpp"
 
-// Manages all the VoiceProcessor instances and the threadpool used for the
+// Manages all the VoiceProcessor instances and the executors used for the
 // processing tasks
 class VoiceManager {
  public:
+  // Current state of the streams and the executors
+  // The counters and the latencies are tracked by Metrics
+  struct Stats {
+    size_t stream_count = 0;
+    // Undecoded audio across all the streams
+    int64_t backlog_ms = 0;
+    size_t realtime_queue_depth = 0;
+    size_t bulk_queue_depth = 0;
+    Executor::QueueWaitStats realtime_queue_wait;
+    Executor::QueueWaitStats bulk_queue_wait;
+  };
+
   VoiceManager(AppConfig config, command_callback cb);
   VoiceManager(const VoiceManager&) = delete;
   VoiceManager(const VoiceManager&&) = delete;
   ~VoiceManager();
 
   // Adds an OPUS frame to the voice processing queue
-  void AddOpusFrame(const std::string& id, const opus_frame& frame);
+  // Reports whether the frame was queued and whether the stream is overloaded
+  IngestStatus AddOpusFrame(const std::string& id, const opus_byte* data,
+                            size_t length);
+
+  // Adds a batch of back to back OPUS frames to the voice processing queue
+  IngestStatus AddOpusFrames(const std::string& id, const opus_byte* data,
+                             const uint32_t* lengths, size_t count);
+
+  // Adds interleaved PCM samples to the voice processing queue
+  IngestStatus AddPCMFrames(const std::string& id, const pcm_frame* data,
+                            size_t sample_count, int sample_rate,
+                            int channels);
+
+  // Removes the stream and its VoiceProcessor
+  // Returns false if the stream doesn't exist
+  bool RemoveStream(const std::string& id);
+
+  // Takes a snapshot of the stats, only the stream count needs the lock
+  Stats GetStats() const;
 
  private:
   // Hashmap to store all the VoiceProcessor instance pointers
   std::unordered_map<std::string, std::shared_ptr<VoiceProcessor>> vp_map;
-  // Threadpool handle
-  std::shared_ptr<ThreadPool> pool;
+  // Guards vp_map, since the idle streams are evicted from the sync thread
+  mutable std::mutex vp_map_mt;
+  // Executor of the stream processing, which is latency sensitive
+  std::unique_ptr<Executor> realtime_pool;
+  // Executor of the command encoding and other bulk work
+  std::unique_ptr<Executor> bulk_pool;
+  // Speech recognition backend shared by all the streams
+  std::shared_ptr<Recognizer> recognizer;
   // N-API callback
   command_callback cb;
   // Applciation wide configuration
   AppConfig config;
+  // Sync callback of the idle stream eviction, 0 if it's disabled
+  Ticker::callback_id eviction_id = 0;
+
+  // Finds the VoiceProcessor for the ID or creates a new one
+  std::shared_ptr<VoiceProcessor> GetVoiceProcessor(const std::string& id);
+
+  // Logs the queue wait statistics of an executor
+  static void LogQueueWaitStats(const Executor& executor);
+
+  // Removes the streams that have been idle for longer than the configured
+  // TTL, invoked by the Ticker once per TTL
+  // Returns the time of the next eviction
+  sync_clock::time_point EvictIdleStreams();
 };
@@ -1,31 +1,51 @@
 #include "VoiceProcessor.hpp"
 
+// Audio decoding settings
+constexpr int audio_rate = 16000;
+constexpr int audio_channels = 1;
+constexpr size_t samples_per_ms = audio_rate / 1000;
+// Skipped audio that precedes the speech in the hotword checks
+constexpr size_t preroll_ms = 300;
+
 // Unnamed namespace for local utilities
 namespace {
-int GetCurrentTimeStampInMs() {
-  return std::chrono::duration_cast<std::chrono::milliseconds>(
-             std::chrono::system_clock::now().time_since_epoch())
-      .count();
+std::chrono::milliseconds ToDuration(int ms) {
+  return std::chrono::milliseconds(ms);
+}
+
+// Amount of decoded samples in a packet, invalid packets count as empty
+size_t PacketSampleCount(const OpusPacketBuffer &packets, size_t index) {
+  const int samples = opus_packet_get_nb_samples(
+      packets.PacketData(index), packets.PacketLength(index), audio_rate);
+  return samples > 0 ? samples : 0;
+}
+
+// Status of a batch, which is the worst status of its parts
+IngestStatus WorseStatus(IngestStatus a, IngestStatus b) {
+  return static_cast<int>(a) > static_cast<int>(b) ? a : b;
 }
 }  // namespace
 
-// Audio decoding settings
-constexpr int audio_rate = 16000;
-constexpr int audio_channels = 1;
+std::atomic<int64_t> VoiceProcessor::total_pending_samples{0};
 
 VoiceProcessor::VoiceProcessor(std::string id, AppConfig config,
-                               const std::shared_ptr<ThreadPool> &pool,
+                               Executor &realtime_pool,
+                               Executor &bulk_pool,
+                               const std::shared_ptr<Recognizer> &recognizer,
                                command_callback cmd_callback)
-    : pool(pool),
+    : bulk_pool(bulk_pool),
+      strand(realtime_pool),
+      recognizer(recognizer),
+      ingest_ring(config.ingest_ring_size),
       detector(config.pv_keyword_path, config.pv_model_path,
-               config.pv_sensitivity,
+               config.pv_sensitivity, config.hotword_max_backlog_ms,
                std::bind(&VoiceProcessor::HotwordCallback, this,
                          std::placeholders::_1)),
-      last_opus_ready_timestamp(GetCurrentTimeStampInMs()),
-      last_pcm_ready_timestamp(GetCurrentTimeStampInMs()),
-      last_hotword_timestamp(GetCurrentTimeStampInMs()),
-      last_pcm_data_timestamp(GetCurrentTimeStampInMs()),
-      decoder(audio_rate, audio_channels)
+      last_pcm_ready_timestamp(sync_clock::now()),
+      last_hotword_timestamp(sync_clock::now()),
+      last_pcm_data_timestamp(sync_clock::now()),
+      decoder(audio_rate, audio_channels),
+      vad(audio_rate)
 
 {
   this->id = std::move(id);
@@ -33,67 +53,335 @@ VoiceProcessor::VoiceProcessor(std::string id, AppConfig config,
 
   // Callback for command text if detected
   this->cmd_callback = std::move(cmd_callback);
+}
+
+std::shared_ptr<VoiceProcessor> VoiceProcessor::Create(
+    std::string id, AppConfig config, Executor &realtime_pool,
+    Executor &bulk_pool, const std::shared_ptr<Recognizer> &recognizer,
+    command_callback cmd_callback) {
+  auto vp = std::make_shared<VoiceProcessor>(std::move(id), std::move(config),
+                                             realtime_pool, bulk_pool,
+                                             recognizer,
+                                             std::move(cmd_callback));
 
   // Register a callback for the sync thread
-  Ticker::RegisterCallback(std::bind(&VoiceProcessor::OnSync, this));
+  // It only gets invoked once there is something to process
+  // A weak reference lets the instance get destroyed while registered
+  std::weak_ptr<VoiceProcessor> weak_vp = vp;
+  vp->sync_id = Ticker::RegisterCallback([weak_vp]() {
+    auto vp = weak_vp.lock();
+    return vp ? vp->OnSync() : sync_clock::time_point::max();
+  });
+
+  return vp;
+}
+
+VoiceProcessor::~VoiceProcessor() {
+  Ticker::UnregisterCallback(sync_id);
+
+  // The undecoded audio of the stream is discarded
+  total_pending_samples -= pending_samples;
 }
 
-void VoiceProcessor::AddOpusFrame(const std::vector<unsigned char> &frame) {
+void VoiceProcessor::Close() {
+  // Stop the syncs first, so that no new processing gets triggered
+  Ticker::UnregisterCallback(sync_id);
+
   std::lock_guard<std::mutex> lk(mt);
+  closed = true;
+
+  // Finish the command that was being spoken, the already enqueued tasks keep
+  // this instance alive until they are done
+  if (currently_processing_command) {
+    SPDLOG_INFO(
+        "VoiceProcessor::Close : Triggering CommandSegment->StartProcessing() "
+        "for the removed stream ID:{}.",
+        id);
+    currently_processing_command = false;
+    EndCommand("closed");
+  }
+}
 
-  // Add frames to the opus decoding queue
-  opus_frames.push_back(frame);
+bool VoiceProcessor::IsIdle(sync_clock::time_point current_time,
+                            sync_clock::duration idle_ttl) const {
+  if (opus_sync_requested || HasPendingOpusFrames()) {
+    return false;
+  }
+
+  const auto last_activity =
+      sync_clock::time_point(sync_clock::duration(opus_pending_since));
+  return current_time - last_activity >= idle_ttl;
+}
+
+IngestStatus VoiceProcessor::AddOpusFrame(const opus_byte *data,
+                                          size_t length) {
+  Metrics::Increment(Metrics::Counter::FramesReceived);
+
+  const int frame_samples =
+      opus_packet_get_nb_samples(data, length, audio_rate);
+  const size_t sample_count = frame_samples > 0 ? frame_samples : 0;
+
+  const auto status = AdmitAudio(sample_count);
+  if (status == IngestStatus::Dropped) {
+    Metrics::Increment(Metrics::Counter::FramesDropped);
+    dropped_frames++;
+    SPDLOG_DEBUG(
+        "VoiceProcessor::AddOpusFrame : Backlog limit reached for ID:{}. "
+        "Dropped {} frames so far.",
+        id, dropped_frames.load());
+    return status;
+  }
+
+  // Add frames to the opus decoding queue without locking, unless earlier
+  // frames are still waiting in the overflow buffer
+  if (spilling || !ingest_ring.TryPush(data, length)) {
+    if (!HandleIngestOverflow(data, length)) {
+      return IngestStatus::Dropped;
+    }
+  }
+
+  pending_samples += sample_count;
+  total_pending_samples += sample_count;
+  RequestOpusSync();
+  return status;
 }
 
-void VoiceProcessor::OnSync() {
+IngestStatus VoiceProcessor::AddOpusFrames(const opus_byte *data,
+                                           const uint32_t *lengths,
+                                           size_t count) {
+  auto status = IngestStatus::Ok;
+  for (size_t i = 0; i < count; i++) {
+    status = WorseStatus(status, AddOpusFrame(data, lengths[i]));
+    data += lengths[i];
+  }
+
+  return status;
+}
+
+IngestStatus VoiceProcessor::AddPCMFrames(const pcm_frame *data,
+                                          size_t sample_count, int sample_rate,
+                                          int channels) {
+  Metrics::Increment(Metrics::Counter::FramesReceived);
+
+  if (!pcm_converter || !pcm_converter->Matches(sample_rate, channels)) {
+    pcm_converter =
+        std::make_unique<PCMConverter>(sample_rate, channels, audio_rate);
+  }
+
+  // The admission only needs the approximate length after the resampling
+  const auto status =
+      AdmitAudio(sample_count / channels * audio_rate / sample_rate);
+  if (status == IngestStatus::Dropped) {
+    // A PCM batch counts as a single frame, like it does when it's received
+    Metrics::Increment(Metrics::Counter::FramesDropped);
+    dropped_frames++;
+    SPDLOG_DEBUG(
+        "VoiceProcessor::AddPCMFrames : Backlog limit reached for ID:{}. "
+        "Dropped {} samples.",
+        id, sample_count);
+    return status;
+  }
+
+  // The conversion is cheap enough for the producer thread, which keeps the
+  // converter state ordered without locking
+  // It runs outside of the lock, so that the decoding task doesn't wait for it
+  pcm_converted.clear();
+  pcm_converter->Convert(data, sample_count, pcm_converted);
+  const size_t converted_count = pcm_converted.size();
+  {
+    std::lock_guard<std::mutex> lk(mt);
+    // Swapping keeps the capacity of both buffers
+    if (pcm_input.empty()) {
+      std::swap(pcm_input, pcm_converted);
+    } else {
+      pcm_input.insert(pcm_input.end(), pcm_converted.begin(),
+                       pcm_converted.end());
+    }
+  }
+
+  // The frames wait for the decoding task like the OPUS ones do
+  pending_samples += converted_count;
+  total_pending_samples += converted_count;
+  has_pcm_input = true;
+  RequestOpusSync();
+  return status;
+}
+
+bool VoiceProcessor::HandleIngestOverflow(const opus_byte *data,
+                                          size_t length) {
+  if (config.ingest_overflow_policy == IngestOverflowPolicy::Drop) {
+    Metrics::Increment(Metrics::Counter::FramesDropped);
+    dropped_frames++;
+    SPDLOG_DEBUG(
+        "VoiceProcessor::HandleIngestOverflow : Ingest ring full for ID:{}. "
+        "Dropped {} frames so far.",
+        id, dropped_frames.load());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lk(mt);
+
+  // Keep spilling until the consumer drains the overflow buffer
+  spilling = true;
+  opus_frames.Add(data, length);
+  return true;
+}
+
+int64_t VoiceProcessor::GetTotalBacklogMs() {
+  return std::max<int64_t>(total_pending_samples, 0) / samples_per_ms;
+}
+
+IngestStatus VoiceProcessor::AdmitAudio(size_t sample_count) {
+  const int64_t stream_limit = StreamBacklogLimit();
+  const int64_t total_limit =
+      static_cast<int64_t>(samples_per_ms) * std::max(config.max_backlog_ms, 0);
+  // The counters can be briefly negative, when the consumer drains audio that
+  // the producer hasn't counted yet
+  const int64_t new_samples = sample_count;
+  const int64_t stream_backlog = pending_samples + new_samples;
+  const bool stream_overloaded =
+      stream_limit > 0 && stream_backlog > stream_limit;
+  const bool total_overloaded =
+      total_limit > 0 && total_pending_samples + new_samples > total_limit;
+
+  if (!stream_overloaded && !total_overloaded) {
+    return IngestStatus::Ok;
+  }
+
+  // The audio of a command can't be recovered, so it's never shed
+  if (currently_processing_command) {
+    return IngestStatus::Overloaded;
+  }
+
+  // The decoding task sheds the oldest audio beyond the stream limit, so the
+  // new audio is only dropped once the decoding has stalled
+  // Over the process limit, the streams that don't have a command drop their
+  // new audio to let the others catch up
+  if (total_overloaded || stream_backlog > 2 * stream_limit) {
+    return IngestStatus::Dropped;
+  }
+
+  return IngestStatus::Overloaded;
+}
+
+size_t VoiceProcessor::StreamBacklogLimit() const {
+  return samples_per_ms * std::max(config.stream_max_backlog_ms, 0);
+}
+
+void VoiceProcessor::ShedBacklog(OpusPacketBuffer &packets,
+                                 size_t &sample_count) {
+  // Only called from the strand
+  const size_t limit = StreamBacklogLimit();
+  if (limit == 0 || sample_count <= limit || currently_processing_command) {
+    return;
+  }
+
+  // The hotword detection only needs the newest audio
+  size_t dropped_count = 0;
+  while (dropped_count < packets.Size() && sample_count > limit) {
+    sample_count -= PacketSampleCount(packets, dropped_count++);
+  }
+  packets.DropFront(dropped_count);
+  dropped_frames += dropped_count;
+  Metrics::Increment(Metrics::Counter::FramesDropped, dropped_count);
+
+  SPDLOG_DEBUG(
+      "VoiceProcessor::ShedBacklog : Dropped the {} oldest frames of ID:{}.",
+      dropped_count, id);
+}
+
+void VoiceProcessor::ShedBacklog(std::vector<pcm_frame> &frames) {
+  // Only called from the strand
+  const size_t limit = StreamBacklogLimit();
+  if (limit == 0 || frames.size() <= limit || currently_processing_command) {
+    return;
+  }
+
+  const size_t dropped_count = frames.size() - limit;
+  frames.erase(frames.begin(), frames.begin() + dropped_count);
+  // The batches are merged by now, so the shed samples count as one frame
+  Metrics::Increment(Metrics::Counter::FramesDropped);
+  dropped_frames++;
+
+  SPDLOG_DEBUG(
+      "VoiceProcessor::ShedBacklog : Dropped the {} oldest samples of ID:{}.",
+      dropped_count, id);
+}
+
+bool VoiceProcessor::HasPendingOpusFrames() const {
+  return spilling || !ingest_ring.Empty();
+}
+
+void VoiceProcessor::RequestOpusSync() {
+  // Only the first frame after a flush schedules a sync, so the Ticker lock is
+  // taken once per buffer TTL at most
+  if (opus_sync_requested.exchange(true)) {
+    return;
+  }
+
+  const auto current_time = sync_clock::now();
+  opus_pending_since = current_time.time_since_epoch().count();
+  Ticker::Schedule(sync_id,
+                   current_time + ToDuration(config.max_buffer_ttl_ms));
+}
+
+sync_clock::time_point VoiceProcessor::OnSync() {
   std::lock_guard<std::mutex> lk(mt);
 
   SPDLOG_TRACE("VoiceProcessor::OnSync : Invoked for ID:{}.", id);
 
-  const int current_time = GetCurrentTimeStampInMs();
+  const auto current_time = sync_clock::now();
+  const auto buffer_ttl = ToDuration(config.max_buffer_ttl_ms);
+  auto next_sync = sync_clock::time_point::max();
 
   SPDLOG_TRACE(
-      "VoiceProcessor::OnSync : opus_frames: {}, pcm_frames: {}, "
+      "VoiceProcessor::OnSync : pending opus_frames: {}, pcm_frames: {}, "
       "command_segments: {}.",
-      opus_frames.size(), pcm_frames.size(), command_segments.size());
+      HasPendingOpusFrames(), pcm_chunk_samples, command_segments.size());
 
   // Check OPUS buffer timeouts
-  if (!opus_frames.empty()) {
-    if (current_time - last_opus_ready_timestamp > config.max_buffer_ttl_ms) {
+  if (opus_sync_requested) {
+    const auto opus_deadline =
+        sync_clock::time_point(sync_clock::duration(opus_pending_since)) +
+        buffer_ttl;
+    if (current_time >= opus_deadline) {
       SPDLOG_DEBUG("VoiceProcessor::OnSync : Triggering DecodeOPUS.");
       DecodeOPUS();
+    } else {
+      next_sync = std::min(next_sync, opus_deadline);
     }
-  } else {
-    // If the buffer is empty, reset the timestamp as this should be treated
-    // as a "silence" input
-    last_opus_ready_timestamp = current_time;
   }
 
   // Check PCM buffer timeouts
-  if (!pcm_frames.empty()) {
-    if (current_time - last_pcm_ready_timestamp > config.max_buffer_ttl_ms) {
+  // The timestamp is set when the frames are added to an empty buffer
+  if (!pcm_chunks.empty()) {
+    const auto pcm_deadline = last_pcm_ready_timestamp + buffer_ttl;
+    if (current_time >= pcm_deadline) {
       SPDLOG_DEBUG("VoiceProcessor::OnSync : Triggering CheckForHotwords.");
       CheckForHotwords();
+    } else {
+      next_sync = std::min(next_sync, pcm_deadline);
     }
-  } else {
-    // If the buffer is empty, reset the timestamp as this should be treated
-    // as a "silence" input
-    last_pcm_ready_timestamp = current_time;
   }
 
   // Check if we hit the time limit for a command
   if (currently_processing_command) {
-    if (current_time - last_hotword_timestamp > config.max_command_length_ms) {
+    const auto length_deadline =
+        last_hotword_timestamp + ToDuration(config.max_command_length_ms);
+    const auto silence_deadline =
+        last_pcm_data_timestamp +
+        ToDuration(config.max_command_silence_length_ms);
+
+    if (current_time >= length_deadline) {
       SPDLOG_INFO(
           "VoiceProcessor::OnSync : Triggering "
           "CommandSegment->StartProcessing().");
       // Set as not processing
       currently_processing_command = false;
       // Set command segment as ready and process
-      command_segments.back()->StartProcessing();
+      EndCommand("length", {}, length_deadline);
 
-    } else if (current_time - last_pcm_data_timestamp >
-               config.max_command_silence_length_ms) {
+    } else if (current_time >= silence_deadline) {
       SPDLOG_INFO(
           "VoiceProcessor::OnSync : Triggering "
           "CommandSegment->StartProcessing() "
@@ -102,12 +390,11 @@ void VoiceProcessor::OnSync() {
       // Set as not processing
       currently_processing_command = false;
       // Set command segment as ready and process
-      command_segments.back()->StartProcessing();
+      EndCommand("silence", last_pcm_data_timestamp, silence_deadline);
+    } else {
+      next_sync =
+          std::min(next_sync, std::min(length_deadline, silence_deadline));
     }
-  } else {
-    // If we're not procesing a command, reset the timestamp as this should be
-    // treated as a "pending" input
-    last_hotword_timestamp = current_time;
   }
 
   // Cleanup old redundant CommandProcessor entries
@@ -118,57 +405,237 @@ void VoiceProcessor::OnSync() {
       i++;
     }
   }
+
+  return next_sync;
 }
 
 void VoiceProcessor::DecodeOPUS() {
   // Only called from the sync thread that already has a lock acquired
 
-  // Set the updated timestamp
-  last_opus_ready_timestamp = GetCurrentTimeStampInMs();
+  // Frames that arrive after this point need a new sync, since the decoding
+  // task might have already drained the queue by then
+  opus_sync_requested = false;
+
+  // The queued task also decodes the frames that arrived since
+  if (decode_queued.exchange(true)) {
+    return;
+  }
 
-  // Enqueue a task for the threadpool to process
+  // Queue a task on the stream's strand
   // Docode OPUS frames into PCM and append to the buffer
-  pool->enqueue([this]() {
-    auto opus_frames = this->FlushOpusFrames();
-    auto pcm_buffer = this->decoder.Decode(opus_frames);
-    this->EnqueuePCMFrames(pcm_buffer);
+  strand.Post([this, self = shared_from_this()]() {
+    this->decode_queued = false;
+    this->FlushOpusFrames(this->decoding_opus_frames);
+
+    size_t sample_count = 0;
+    for (size_t i = 0; i < this->decoding_opus_frames.Size(); i++) {
+      sample_count += PacketSampleCount(this->decoding_opus_frames, i);
+    }
+    this->pending_samples -= sample_count;
+    total_pending_samples -= sample_count;
+    this->ShedBacklog(this->decoding_opus_frames, sample_count);
+
+    // PCM input only needs to be queued, it's already in the right format
+    auto input_chunk = PCMChunkPool::Acquire();
+    this->FlushPCMInput(input_chunk->frames);
+    this->pending_samples -= input_chunk->Size();
+    total_pending_samples -= input_chunk->Size();
+    this->ShedBacklog(input_chunk->frames);
+    if (!input_chunk->Empty()) {
+      this->EnqueuePCMFrames(input_chunk, this->decoding_opus_frames, false);
+    }
+
+    // Nothing is left when an earlier task already drained the ring, the
+    // stream only gets PCM input or the shedding dropped every packet
+    if (this->decoding_opus_frames.Empty()) {
+      return;
+    }
+
+    // The decoded audio goes straight into a chunk that gets shared with the
+    // hotword queue and the command
+    auto chunk = PCMChunkPool::Acquire();
+
+    // Batches of silence packets only need their length, which is the common
+    // case for the streams that are idle
+    if (this->IsSilence(this->decoding_opus_frames)) {
+      chunk->frames.assign(sample_count * audio_channels, 0);
+      this->decoder.SkipSilence();
+      this->EnqueuePCMFrames(chunk, this->decoding_opus_frames, true);
+      return;
+    }
+
+    const auto decode_start = Metrics::clock::now();
+    this->decoder.Decode(this->decoding_opus_frames, chunk->frames);
+    Metrics::Record(Metrics::Stage::OpusDecode,
+                    Metrics::clock::now() - decode_start);
+    this->EnqueuePCMFrames(chunk, this->decoding_opus_frames, false);
   });
 }
 
 void VoiceProcessor::CheckForHotwords() {
   // Only called from the sync thread that already has a lock acquired
 
-  // Set the updated timestamp
-  last_pcm_ready_timestamp = GetCurrentTimeStampInMs();
+  // The queued task also checks the chunks that arrived since
+  if (check_queued.exchange(true)) {
+    return;
+  }
 
-  // Enqueue a task for the threadpool to process
+  // Queue a task on the stream's strand
   // Check the PCM audio data for hotwords
-  pool->enqueue([this]() {
-    auto pcm_data = this->FlushPCMFrames();
-    detector.Check(pcm_data);
+  strand.Post([this, self = shared_from_this()]() {
+    this->check_queued = false;
+    bool voiced = true;
+    this->FlushPCMFrames(this->checking_pcm_chunks, voiced);
+
+    // Chunks without speech can't contain a hotword
+    // The last ones are kept as the pre-roll of the next voiced batch
+    if (!voiced) {
+      SPDLOG_TRACE("VoiceProcessor::CheckForHotwords : Skipping silence.");
+      for (auto &chunk : this->checking_pcm_chunks) {
+        this->preroll_pcm_samples += chunk->Size();
+        this->preroll_pcm_chunks.push_back(std::move(chunk));
+      }
+      this->checking_pcm_chunks.clear();
+
+      // Drop the oldest chunks that the window doesn't need
+      auto &preroll = this->preroll_pcm_chunks;
+      size_t dropped = 0;
+      while (dropped < preroll.size() &&
+             this->preroll_pcm_samples - preroll[dropped]->Size() >=
+                 preroll_ms * samples_per_ms) {
+        this->preroll_pcm_samples -= preroll[dropped++]->Size();
+      }
+      preroll.erase(preroll.begin(), preroll.begin() + dropped);
+      return;
+    }
+
+    // The pre-roll goes first, the hotword callback passes it on to the
+    // command along with the rest when the hotword ends in it
+    if (!this->preroll_pcm_chunks.empty()) {
+      this->checking_pcm_chunks.insert(
+          this->checking_pcm_chunks.begin(),
+          std::make_move_iterator(this->preroll_pcm_chunks.begin()),
+          std::make_move_iterator(this->preroll_pcm_chunks.end()));
+      this->preroll_pcm_chunks.clear();
+      this->preroll_pcm_samples = 0;
+    }
+
+    // The audio after a hotword belongs to the command, so the checks stop
+    // once one is detected
+    // The hotword callback picks up the chunks that weren't checked
+    const auto check_start = Metrics::clock::now();
+    for (next_checking_chunk = 0;
+         next_checking_chunk < this->checking_pcm_chunks.size();) {
+      const auto &chunk = this->checking_pcm_chunks[next_checking_chunk++];
+      if (detector.Check(chunk->Data(), chunk->Size())) {
+        break;
+      }
+    }
+    Metrics::Record(Metrics::Stage::HotwordCheck,
+                    Metrics::clock::now() - check_start);
+
+    // Release the chunks for reuse
+    this->checking_pcm_chunks.clear();
   });
 }
 
-void VoiceProcessor::CommandCallback(std::string &data) {
+void VoiceProcessor::CommandCallback(CommandResult &result) {
   // Wrap the text command callback with source ID and invoke the general
   // callback
-  cmd_callback(id, data);
+  cmd_callback(id, result);
+
+  // Schedule a sync to clean up the finished command segment
+  if (result.is_final) {
+    Ticker::Schedule(sync_id, sync_clock::now() +
+                                  ToDuration(config.max_buffer_ttl_ms));
+  }
 }
 
-void VoiceProcessor::EnqueuePCMFrames(std::vector<pcm_frame> &new_pcm_frames) {
+void VoiceProcessor::EnqueuePCMFrames(
+    const PCMChunkPool::chunk &new_pcm_frames, const OpusPacketBuffer &packets,
+    bool silence) {
   std::lock_guard<std::mutex> lk(mt);
 
+  // Nothing processes the audio of a removed stream
+  if (closed) {
+    return;
+  }
+
   // Update timestamp
-  last_pcm_data_timestamp = GetCurrentTimeStampInMs();
+  // Silence packets count towards the command silence timeout
+  const auto current_time = sync_clock::now();
+  if (!silence) {
+    last_pcm_data_timestamp = current_time;
+  }
 
   // If a command is being currently processed, also append to that command
   // processor
   if (currently_processing_command) {
-    command_segments.back()->AddAudio(new_pcm_frames);
+    if (UsesCommandPackets()) {
+      command_segments.back()->AddPackets(packets);
+    } else {
+      command_segments.back()->AddAudio(new_pcm_frames);
+    }
   }
+  if (UsesCommandPackets()) {
+    AppendToHistory(packets);
+  }
+
+  // Classify the audio for the hotword gating and the endpointing
+  // Silence packets skip the hotword detection even without the VAD
+  bool voiced = false;
+  if (silence) {
+    vad.AddSilence(new_pcm_frames->Size());
+  } else {
+    voiced = !config.vad_enabled ||
+             vad.Process(new_pcm_frames->Data(), new_pcm_frames->Size());
+  }
+
+  // End the command once the speaker has been silent for long enough
+  if (currently_processing_command && config.vad_enabled &&
+      config.vad_end_silence_ms > 0 &&
+      vad.GetTrailingSilenceMs() >= config.vad_end_silence_ms) {
+    SPDLOG_INFO(
+        "VoiceProcessor::EnqueuePCMFrames : Triggering "
+        "CommandSegment->StartProcessing() due to trailing silence.");
+    currently_processing_command = false;
+    EndCommand("vad", current_time - std::chrono::milliseconds(
+                                         vad.GetTrailingSilenceMs()));
+  }
+
   // Add to the hotword detection queue
-  pcm_frames.insert(pcm_frames.end(), new_pcm_frames.begin(),
-                    new_pcm_frames.end());
+  // The buffer TTL starts when the first frames are added to an empty queue
+  if (pcm_chunks.empty() && !new_pcm_frames->Empty()) {
+    last_pcm_ready_timestamp = current_time;
+    Ticker::Schedule(sync_id,
+                     current_time + ToDuration(config.max_buffer_ttl_ms));
+  }
+
+  if (!new_pcm_frames->Empty()) {
+    pcm_chunks.push_back(new_pcm_frames);
+    pcm_chunk_samples += new_pcm_frames->Size();
+  }
+  pcm_frames_voiced |= voiced;
+
+  // When the checks fall behind, drop the oldest chunks beyond the detection
+  // backlog, which the detector would skip anyway
+  // The command audio isn't affected, since the command holds its own
+  // references
+  const size_t max_samples =
+      samples_per_ms * std::max(config.hotword_max_backlog_ms, 0);
+  size_t dropped_chunks = 0;
+  while (max_samples > 0 && pcm_chunks.size() - dropped_chunks > 1 &&
+         pcm_chunk_samples - pcm_chunks[dropped_chunks]->Size() >=
+             max_samples) {
+    pcm_chunk_samples -= pcm_chunks[dropped_chunks++]->Size();
+  }
+  if (dropped_chunks > 0) {
+    pcm_chunks.erase(pcm_chunks.begin(), pcm_chunks.begin() + dropped_chunks);
+    SPDLOG_DEBUG(
+        "VoiceProcessor::EnqueuePCMFrames : Dropped {} unchecked chunks of "
+        "ID:{}.",
+        dropped_chunks, id);
+  }
 }
 
 void VoiceProcessor::HotwordCallback(
@@ -177,9 +644,16 @@ void VoiceProcessor::HotwordCallback(
 
   SPDLOG_DEBUG("VoiceProcessor::HotwordCallback : Invoked.");
 
+  // Don't start new commands for a removed stream
+  if (closed) {
+    return;
+  }
+
+  Metrics::Increment(Metrics::Counter::HotwordsDetected);
+
   // If currently processing another command, register it as ready
   if (currently_processing_command) {
-    command_segments.back()->StartProcessing();
+    EndCommand("hotword");
 
     SPDLOG_DEBUG(
         "VoiceProcessor::HotwordCallback : Setting last command processor "
@@ -194,46 +668,183 @@ void VoiceProcessor::HotwordCallback(
         "currently_processing_command.");
   }
 
-  // Set the timestamp
-  last_hotword_timestamp = GetCurrentTimeStampInMs();
+  // The silence before the hotword doesn't count towards the command end
+  vad.ResetTrailingSilence();
 
-  // Create a full audio buffer from existing and leftover pcm frames
-  std::vector<pcm_frame> full_pcm_buffer;
-  full_pcm_buffer.insert(full_pcm_buffer.end(), leftover_pcm_frames.begin(),
-                         leftover_pcm_frames.end());
-  full_pcm_buffer.insert(full_pcm_buffer.end(), pcm_frames.begin(),
-                         pcm_frames.end());
+  // Set the timestamp and schedule a sync for the command timeouts
+  last_hotword_timestamp = sync_clock::now();
+  Ticker::Schedule(
+      sync_id,
+      std::min(last_hotword_timestamp +
+                   ToDuration(config.max_command_length_ms),
+               last_pcm_data_timestamp +
+                   ToDuration(config.max_command_silence_length_ms)));
 
   // Add a new command segment
+  // The callback keeps this instance alive until the command is processed
   auto new_command_processor = std::make_shared<CommandProcessor>(
-      config, pool,
-      std::bind(&VoiceProcessor::CommandCallback, this, std::placeholders::_1));
-
-  new_command_processor->AddAudio(full_pcm_buffer);
+      config, bulk_pool, recognizer, Tracer::NextTraceId(),
+      [self = shared_from_this()](CommandResult &result) {
+        self->CommandCallback(result);
+      });
+
+  // The command starts with the leftover frames, followed by the chunks of
+  // the current check that come after the detection and the queued ones
+  // The callback runs within the check, so its chunks can be read here
+  const auto unchecked_begin =
+      checking_pcm_chunks.begin() + next_checking_chunk;
+  if (UsesCommandPackets()) {
+    // These frames were decoded from the newest history packets
+    size_t sample_count = leftover_pcm_frames.size() + pcm_chunk_samples;
+    for (auto i = unchecked_begin; i != checking_pcm_chunks.end(); i++) {
+      sample_count += (*i)->Size();
+    }
+    AddHistoryToCommand(*new_command_processor, sample_count);
+  } else {
+    new_command_processor->AddAudio(
+        PCMChunkPool::Acquire(leftover_pcm_frames));
+    for (auto i = unchecked_begin; i != checking_pcm_chunks.end(); i++) {
+      new_command_processor->AddAudio(*i);
+    }
+    for (const auto &chunk : pcm_chunks) {
+      new_command_processor->AddAudio(chunk);
+    }
+  }
   command_segments.push_back(std::move(new_command_processor));
 
   SPDLOG_DEBUG(
-      "VoiceProcessor::HotwordCallback : New command processor added.");
+      "VoiceProcessor::HotwordCallback : New command processor added, trace "
+      "ID:{}.",
+      command_segments.back()->GetTraceId());
 }
 
-std::vector<opus_frame> VoiceProcessor::FlushOpusFrames() {
-  std::lock_guard<std::mutex> lk(mt);
+void VoiceProcessor::EndCommand(const char *reason,
+                                sync_clock::time_point silence_start,
+                                sync_clock::time_point deadline) {
+  // Only called with a lock acquired
+  auto &command = *command_segments.back();
+
+  if (Tracer::IsEnabled()) {
+    const auto current_time = sync_clock::now();
+    const auto trace_id = command.GetTraceId();
+    Tracer::RecordSpan(trace_id, "command", last_hotword_timestamp,
+                       current_time, reason);
+    if (silence_start != sync_clock::time_point()) {
+      Tracer::RecordSpan(trace_id, "silence", silence_start, current_time);
+    }
+    // How late the sync was, e.g. due to the Ticker or the lock
+    if (deadline != sync_clock::time_point()) {
+      Tracer::RecordSpan(trace_id, "tickWait", deadline, current_time);
+    }
+  }
+
+  command.StartProcessing();
+}
 
-  // Move to prevent copy constructor invocation and then reset the variable
-  // state via clear()
-  auto ret = std::move(opus_frames);
-  opus_frames.clear();
+bool VoiceProcessor::IsSilence(const OpusPacketBuffer &packets) {
+  // An empty batch has no silence that would bypass the decoder
+  if (packets.Empty()) {
+    return false;
+  }
 
-  return ret;
+  for (size_t i = 0; i < packets.Size(); i++) {
+    if (!OpusFrameDecoder::IsSilencePacket(packets.PacketData(i),
+                                           packets.PacketLength(i))) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool VoiceProcessor::UsesCommandPackets() const {
+  // The streaming recognizer sends the decoded audio instead, while the PCM
+  // input has no packets to pass through
+  return config.command_audio_mode == CommandAudioMode::Passthrough &&
+         config.streaming_recognizer_url.empty() && !has_pcm_input;
 }
 
-std::vector<pcm_frame> VoiceProcessor::FlushPCMFrames() {
+void VoiceProcessor::AppendToHistory(const OpusPacketBuffer &packets) {
+  // Only called with a lock acquired
+
+  // The history needs to cover all the audio that can precede a hotword: the
+  // detection backlog and the audio waiting in the OPUS and PCM buffers
+  const size_t window_samples =
+      static_cast<size_t>(audio_rate / 1000) *
+      (config.hotword_max_backlog_ms + 2 * config.max_buffer_ttl_ms);
+
+  if (history_current_samples >= window_samples) {
+    std::swap(history_previous, history_current);
+    history_current.Clear();
+    history_current_samples = 0;
+  }
+
+  for (size_t i = 0; i < packets.Size(); i++) {
+    history_current_samples += PacketSampleCount(packets, i);
+  }
+  history_current.Append(packets);
+}
+
+void VoiceProcessor::AddHistoryToCommand(CommandProcessor &command,
+                                         size_t sample_count) {
+  // Only called with a lock acquired
+
+  // Walk back from the newest packet until the requested audio is covered
+  // The command starts at a packet boundary, so it can include up to one
+  // packet of audio that preceded the leftover frames
+  size_t covered_samples = 0;
+  size_t first_current = history_current.Size();
+  while (first_current > 0 && covered_samples < sample_count) {
+    covered_samples += PacketSampleCount(history_current, --first_current);
+  }
+
+  size_t first_previous = history_previous.Size();
+  while (first_previous > 0 && covered_samples < sample_count) {
+    covered_samples += PacketSampleCount(history_previous, --first_previous);
+  }
+
+  command.AddPackets(history_previous, first_previous);
+  command.AddPackets(history_current, first_current);
+}
+
+void VoiceProcessor::FlushOpusFrames(OpusPacketBuffer &flushed_frames) {
+  // Only called from the strand
+  flushed_frames.Clear();
+  ingest_ring.DrainInto(flushed_frames);
+
+  if (!spilling) {
+    return;
+  }
+
   std::lock_guard<std::mutex> lk(mt);
 
-  // Move to prevent copy constructor invocation and then reset the variable
-  // state via clear()
-  const auto ret = std::move(pcm_frames);
-  pcm_frames.clear();
+  // Frames that were pushed to the ring before the spill started are older
+  // than the spilled ones, so drain the ring again before appending them
+  // The producer doesn't push to the ring while spilling is set
+  ingest_ring.DrainInto(flushed_frames);
+  flushed_frames.Append(opus_frames);
+  opus_frames.Clear();
+  spilling = false;
+}
+
+void VoiceProcessor::FlushPCMInput(std::vector<pcm_frame> &flushed_input) {
+  // Only called from the strand
+  // Swapping keeps the capacity of both buffers
+  flushed_input.clear();
+
+  std::lock_guard<std::mutex> lk(mt);
+  std::swap(flushed_input, pcm_input);
+}
+
+void VoiceProcessor::FlushPCMFrames(
+    std::vector<PCMChunkPool::chunk> &flushed_chunks, bool &voiced) {
+  // Swapping keeps the capacity of both vectors
+  flushed_chunks.clear();
+
+  std::lock_guard<std::mutex> lk(mt);
+  std::swap(flushed_chunks, pcm_chunks);
+  pcm_chunk_samples = 0;
 
-  return ret;
+  voiced = pcm_frames_voiced;
+  pcm_frames_voiced = false;
 }
@@ -1,39 +1,103 @@
 #pragma once
 
-#include <ThreadPool.h>
 #include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <functional>
+#include <iterator>
 #include <memory>
 #include <mutex>
 #include <string>
 #include <vector>
+#include "../Buffers/OpusPacketBuffer.hpp"
+#include "../Buffers/PCMChunkPool.hpp"
+#include "../Buffers/SpscPacketRing.hpp"
 #include "../Codecs/OpusDecoder.hpp"
+#include "../Codecs/PCMConverter.hpp"
 #include "../Config/AppConfig.hpp"
+#include "../Executor/Executor.hpp"
+#include "../Executor/Strand.hpp"
+#include "../Metrics/Metrics.hpp"
+#include "../Metrics/Tracer.hpp"
+#include "../Recognizers/Recognizer.hpp"
 #include "../Ticker/Ticker.hpp"
 #include "../types.h"
 #include "CommandProcessor.hpp"
 #include "HotwordDetector.hpp"
+#include "VoiceActivityDetector.hpp"
 
 // The instance of this class is responsible for processing the audio input of a
 // single source
 // It will also invoke a callback once the command speech is detected and parsed
 // to text
-class VoiceProcessor {
+class VoiceProcessor : public std::enable_shared_from_this<VoiceProcessor> {
  public:
-  VoiceProcessor(std::string id, AppConfig config,
-                 const std::shared_ptr<ThreadPool> &pool,
+  // Use Create() instead, which also registers the sync callback
+  // The stream is processed on the realtime executor, while its commands are
+  // encoded on the bulk one
+  VoiceProcessor(std::string id, AppConfig config, Executor &realtime_pool,
+                 Executor &bulk_pool,
+                 const std::shared_ptr<Recognizer> &recognizer,
                  command_callback cmd_callback);
+  VoiceProcessor(const VoiceProcessor &) = delete;
+  VoiceProcessor(const VoiceProcessor &&) = delete;
+  ~VoiceProcessor();
+
+  // Creates a new instance and registers it for syncs
+  static std::shared_ptr<VoiceProcessor> Create(
+      std::string id, AppConfig config, Executor &realtime_pool,
+      Executor &bulk_pool, const std::shared_ptr<Recognizer> &recognizer,
+      command_callback cmd_callback);
+
+  // Stops processing the stream
+  // Pending audio is discarded, while the command that is being spoken gets
+  // processed and delivered
+  // In-flight tasks keep the instance alive until they are done
+  void Close();
+
+  // Whether the stream has had no input for at least idle_ttl
+  bool IsIdle(sync_clock::time_point current_time,
+              sync_clock::duration idle_ttl) const;
 
   // Adds OPUS frames to the detection queue
-  void AddOpusFrame(const std::vector<unsigned char> &frame);
+  // Must only be called from a single thread, since the queue has a single
+  // producer
+  // Reports whether the frame was queued and whether the backlog is over its
+  // limit
+  IngestStatus AddOpusFrame(const opus_byte *data, size_t length);
+
+  // Adds a batch of back to back OPUS frames to the detection queue
+  // Returns the worst status of the frames
+  IngestStatus AddOpusFrames(const opus_byte *data, const uint32_t *lengths,
+                             size_t count);
+
+  // Adds interleaved PCM samples of the specified format to the detection
+  // queue, converting them to the pipeline format right away
+  // A stream should be fed either PCM or OPUS frames, not both
+  // Must only be called from a single thread, like AddOpusFrame
+  IngestStatus AddPCMFrames(const pcm_frame *data, size_t sample_count,
+                            int sample_rate, int channels);
+
+  // Amount of OPUS frames dropped due to a full ingest ring or the backlog
+  // limits
+  uint64_t GetDroppedFrameCount() const { return dropped_frames; }
+
+  // Undecoded audio across all the streams
+  static int64_t GetTotalBacklogMs();
 
  private:
   // Identifier
   std::string id;
 
-  // Thread pool
-  std::shared_ptr<ThreadPool> pool;
+  // Executor of the command processing
+  Executor &bulk_pool;
+  // Runs the decoding and the hotword checks of the stream in order on the
+  // realtime executor, so the state that only they use doesn't need locking
+  Strand strand;
+
+  // Speech recognition backend
+  std::shared_ptr<Recognizer> recognizer;
 
   // Command callback
   command_callback cmd_callback;
@@ -46,26 +110,90 @@ class VoiceProcessor {
   std::mutex mt;
 
   // Data
-  std::vector<opus_frame> opus_frames;
-  std::vector<pcm_frame> pcm_frames;
+  // Incoming OPUS frames, pushed without locking
+  SpscPacketRing ingest_ring;
+  // Frames that didn't fit into the ingest ring, guarded by mt
+  OpusPacketBuffer opus_frames;
+  // Set by the producer while frames are spilled into opus_frames, so that the
+  // following frames are also spilled to preserve the ordering
+  std::atomic<bool> spilling{false};
+  // Overflow statistics
+  std::atomic<uint64_t> dropped_frames{0};
+  // Undecoded audio of the stream and of all the streams, in samples
+  std::atomic<int64_t> pending_samples{0};
+  static std::atomic<int64_t> total_pending_samples;
+  // Converted PCM input waiting for the next decoding task, guarded by mt
+  std::vector<pcm_frame> pcm_input;
+  // Set once the stream gets PCM input
+  std::atomic<bool> has_pcm_input{false};
+  // Decoded audio awaiting the hotword detection
+  std::vector<PCMChunkPool::chunk> pcm_chunks;
+  size_t pcm_chunk_samples = 0;
+  // Whether any of the queued PCM frames contain speech
+  bool pcm_frames_voiced = false;
   std::vector<std::shared_ptr<CommandProcessor>> command_segments;
 
   // State data
-  int last_hotword_timestamp;
-  int last_pcm_ready_timestamp;
-  int last_opus_ready_timestamp;
-  int last_pcm_data_timestamp;
-  bool currently_processing_command = false;
+  sync_clock::time_point last_hotword_timestamp;
+  sync_clock::time_point last_pcm_ready_timestamp;
+  sync_clock::time_point last_pcm_data_timestamp;
+  // Guarded by mt, but also read by the producer for the backlog shedding
+  std::atomic<bool> currently_processing_command{false};
+  // Set once the stream is removed
+  bool closed = false;
+
+  // Sync scheduling
+  Ticker::callback_id sync_id;
+  // Set by the producer when it schedules a sync for newly pending OPUS
+  // frames, cleared once the frames get dispatched for decoding
+  std::atomic<bool> opus_sync_requested{false};
+  // Arrival time of the oldest pending OPUS frame
+  // Also serves as the last activity time for the idle eviction
+  std::atomic<sync_clock::rep> opus_pending_since{0};
+  // Set while a decoding or a hotword check task waits on the strand
+  // A queued task processes everything that arrives before it runs, so the
+  // syncs don't queue more tasks when the strand falls behind
+  std::atomic<bool> decode_queued{false};
+  std::atomic<bool> check_queued{false};
 
   // Opus decoder
   OpusFrameDecoder decoder;
+  // Converter of the PCM input, only used by the producer
+  // Recreated when the input format changes
+  std::unique_ptr<PCMConverter> pcm_converter;
+  // Output of the converter, only used by the producer
+  std::vector<pcm_frame> pcm_converted;
+  // OPUS packets that are being decoded, only used on the strand
+  // Reused on every flush so that the slab doesn't get reallocated
+  OpusPacketBuffer decoding_opus_frames;
+
+  // Recently decoded OPUS packets in the passthrough mode, guarded by mt
+  // The hotword callback picks the packets that precede the command from here
+  // Two generations are kept, the older one is dropped once the current one
+  // covers the whole window
+  OpusPacketBuffer history_previous;
+  OpusPacketBuffer history_current;
+  size_t history_current_samples = 0;
 
   // Hotword detector
   HotwordDetector detector;
+  // PCM chunks that are being checked for hotwords, and the index of the one
+  // after the chunk that is being checked, only used on the strand
+  std::vector<PCMChunkPool::chunk> checking_pcm_chunks;
+  size_t next_checking_chunk = 0;
+  // Trailing chunks of the skipped silence, checked before the next voiced
+  // ones so that the VAD onset doesn't cut off the start of a hotword, only
+  // used on the strand
+  std::vector<PCMChunkPool::chunk> preroll_pcm_chunks;
+  size_t preroll_pcm_samples = 0;
+
+  // Speech detection on the decoded audio, guarded by mt
+  VoiceActivityDetector vad;
 
   // Sync thread callback, that checks the VoiceProcessor state and invokes
   // processing based on it
-  void OnSync();
+  // Returns the next deadline at which the state needs to be checked
+  sync_clock::time_point OnSync();
 
   // Triggers OPUS buffer decoding
   void DecodeOPUS();
@@ -73,17 +201,64 @@ class VoiceProcessor {
   void CheckForHotwords();
   // Wraps the text command callback with source ID and invokes the general
   // callback
-  void CommandCallback(std::string &data);
+  void CommandCallback(CommandResult &result);
 
   // Appends PCM fromes to the hotword detection queue after the encoding is
   // done
-  void EnqueuePCMFrames(std::vector<pcm_frame> &new_pcm_frames);
+  // The chunk is shared with the command that is being spoken, if any
+  // The packets are the ones the frames were decoded from
+  // Silence frames skip the hotword detection and don't reset the command
+  // silence timeout
+  void EnqueuePCMFrames(const PCMChunkPool::chunk &new_pcm_frames,
+                        const OpusPacketBuffer &packets, bool silence);
   // Callback for when a hotword is detected
   void HotwordCallback(std::vector<pcm_frame> &leftover_pcm_frames);
+  // Starts processing the command that is being spoken
+  // The reason, the start of the silence that ended it and the deadline that
+  // triggered it go to the trace, the time points are optional
+  void EndCommand(const char *reason,
+                  sync_clock::time_point silence_start = {},
+                  sync_clock::time_point deadline = {});
+
+  // Whether all the packets are DTX or silence frames, false if there are none
+  static bool IsSilence(const OpusPacketBuffer &packets);
+
+  // Whether commands are built from the original OPUS packets
+  bool UsesCommandPackets() const;
+  // Appends decoded packets to the passthrough history
+  void AppendToHistory(const OpusPacketBuffer &packets);
+  // Adds the newest history packets covering sample_count samples to a command
+  void AddHistoryToCommand(CommandProcessor &command, size_t sample_count);
+
+  // Handles a frame that didn't fit into the ingest ring
+  // Returns false if the frame was dropped
+  bool HandleIngestOverflow(const opus_byte *data, size_t length);
+
+  // Checks the backlog limits for new audio of the specified length
+  IngestStatus AdmitAudio(size_t sample_count);
+  // Backlog limit of the stream in samples, 0 if disabled
+  size_t StreamBacklogLimit() const;
+  // Drops the oldest packets beyond the stream backlog limit, unless a command
+  // is being spoken
+  // The sample count of the packets is updated accordingly
+  void ShedBacklog(OpusPacketBuffer &packets, size_t &sample_count);
+  // Drops the oldest samples beyond the stream backlog limit, unless a command
+  // is being spoken
+  void ShedBacklog(std::vector<pcm_frame> &frames);
+
+  // Whether there are OPUS frames waiting for decoding
+  bool HasPendingOpusFrames() const;
+
+  // Schedules a sync for frames that arrived into an empty OPUS queue
+  void RequestOpusSync();
 
-  // Flushes and returns the existing OPUS buffer
-  std::vector<opus_frame> FlushOpusFrames();
+  // Flushes the existing OPUS buffer into the specified one
+  void FlushOpusFrames(OpusPacketBuffer &flushed_frames);
+  // Swaps the pending PCM input into the specified buffer
+  void FlushPCMInput(std::vector<pcm_frame> &flushed_input);
 
-  // Flushes and returns the existing PCM buffer
-  std::vector<pcm_frame> FlushPCMFrames();
+  // Swaps the queued PCM chunks into the specified vector
+  // Also reports whether the flushed frames contain speech
+  void FlushPCMFrames(std::vector<PCMChunkPool::chunk> &flushed_chunks,
+                      bool &voiced);
 };
@@ -1,14 +1,162 @@
 #include <napi.h>
+#include <cmath>
 #include <functional>
 #include <memory>
 #include <napi-thread-safe-callback.hpp>
 #include <string>
 #include <vector>
+#include "Buffers/SpscPacketRing.hpp"
+#include "Codecs/PCMConverter.hpp"
 #include "Config/AppConfig.hpp"
+#include "Metrics/Metrics.hpp"
 #include "Utils/LogSetup.hpp"
 #include "VoiceProcessing/VoiceManager.hpp"
 #include "types.h"
 
+// Unnamed namespace for local utilities
+namespace {
+// Limits of the numeric settings
+constexpr size_t min_ingest_ring_size = SpscPacketRing::min_capacity;
+constexpr size_t max_ingest_ring_size = 16 * 1024 * 1024;
+constexpr int max_duration_ms = 24 * 60 * 60 * 1000;
+constexpr int max_hotword_backlog_ms = 60 * 1000;
+constexpr size_t max_pv_prewarm_count = 1024;
+constexpr size_t max_thread_count = 256;
+
+// Reads an optional numeric setting from the options object
+// The value must be between min_value and max_value, otherwise the default is
+// returned with an exception pending
+template <typename T>
+T GetNumberOption(Napi::Object& options, const char* key, T default_value,
+                  T max_value, T min_value = 0) {
+  if (!options.Has(key)) {
+    return default_value;
+  }
+
+  Napi::Value value = options.Get(key);
+  if (!value.IsNumber()) {
+    Napi::TypeError::New(options.Env(),
+                         std::string("Option ") + key + " must be a number.")
+        .ThrowAsJavaScriptException();
+    return default_value;
+  }
+
+  // Checked before the conversion, since converting a negative or out of range
+  // value is undefined
+  const double number = value.As<Napi::Number>().DoubleValue();
+  if (!std::isfinite(number) || number < static_cast<double>(min_value) ||
+      number > static_cast<double>(max_value)) {
+    Napi::RangeError::New(options.Env(),
+                          std::string("Option ") + key + " must be between " +
+                              std::to_string(min_value) + " and " +
+                              std::to_string(max_value) + ".")
+        .ThrowAsJavaScriptException();
+    return default_value;
+  }
+
+  return static_cast<T>(number);
+}
+
+// Reads an optional string setting from the options object
+std::string GetStringOption(Napi::Object& options, const char* key,
+                            const std::string& default_value) {
+  if (!options.Has(key)) {
+    return default_value;
+  }
+
+  Napi::Value value = options.Get(key);
+  if (!value.IsString()) {
+    Napi::TypeError::New(options.Env(),
+                         std::string("Option ") + key + " must be a string.")
+        .ThrowAsJavaScriptException();
+    return default_value;
+  }
+
+  return value.As<Napi::String>();
+}
+
+// Reads an optional boolean setting from the options object
+bool GetBoolOption(Napi::Object& options, const char* key, bool default_value) {
+  if (!options.Has(key)) {
+    return default_value;
+  }
+
+  Napi::Value value = options.Get(key);
+  if (!value.IsBoolean()) {
+    Napi::TypeError::New(options.Env(),
+                         std::string("Option ") + key + " must be a boolean.")
+        .ThrowAsJavaScriptException();
+    return default_value;
+  }
+
+  return value.As<Napi::Boolean>();
+}
+
+// Whether the value is a Uint32Array, other typed arrays have a different
+// element size
+bool IsUint32Array(const Napi::Value& value) {
+  return value.IsTypedArray() &&
+         value.As<Napi::TypedArray>().TypedArrayType() == napi_uint32_array;
+}
+
+// Name of the command status exposed to JS
+const char* GetStatusName(CommandStatus status) {
+  switch (status) {
+    case CommandStatus::Empty:
+      return "empty";
+    case CommandStatus::Error:
+      return "error";
+    case CommandStatus::Ok:
+    default:
+      return "ok";
+  }
+}
+
+// Name of the ingest status exposed to JS
+const char* GetIngestStatusName(IngestStatus status) {
+  switch (status) {
+    case IngestStatus::Overloaded:
+      return "overloaded";
+    case IngestStatus::Dropped:
+      return "dropped";
+    case IngestStatus::Ok:
+    default:
+      return "ok";
+  }
+}
+
+// Converts a latency histogram snapshot to JS, the values are in microseconds
+Napi::Object LatencyToObject(Napi::Env env,
+                             const LatencyHistogram::Snapshot& snapshot) {
+  auto latency = Napi::Object::New(env);
+  latency.Set("count", Napi::Number::New(env, snapshot.count));
+  latency.Set("mean", Napi::Number::New(env, snapshot.mean));
+  latency.Set("max", Napi::Number::New(env, snapshot.max));
+  latency.Set("p50", Napi::Number::New(env, snapshot.p50));
+  latency.Set("p90", Napi::Number::New(env, snapshot.p90));
+  latency.Set("p99", Napi::Number::New(env, snapshot.p99));
+  latency.Set("p999", Napi::Number::New(env, snapshot.p999));
+  return latency;
+}
+
+// Converts the state of an executor queue to JS
+Napi::Object QueueToObject(Napi::Env env, size_t depth,
+                           const Executor::QueueWaitStats& wait) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+
+  const auto total_wait = duration_cast<microseconds>(wait.total_wait);
+  const auto max_wait = duration_cast<microseconds>(wait.max_wait);
+
+  auto queue = Napi::Object::New(env);
+  queue.Set("depth", Napi::Number::New(env, depth));
+  queue.Set("tasks", Napi::Number::New(env, wait.task_count));
+  queue.Set("totalWait", Napi::Number::New(env, total_wait.count()));
+  queue.Set("maxWait", Napi::Number::New(env, max_wait.count()));
+  return queue;
+}
+}  // namespace
+
 // Accessed only from the main thread
 // No locks needed
 class Detector : public Napi::ObjectWrap<Detector> {
@@ -18,7 +166,11 @@ class Detector : public Napi::ObjectWrap<Detector> {
 
     Napi::Function func =
         DefineClass(env, "Detector",
-                    {InstanceMethod("addOpusFrame", &Detector::AddOpusFrame)});
+                    {InstanceMethod("addOpusFrame", &Detector::AddOpusFrame),
+                     InstanceMethod("addOpusFrames", &Detector::AddOpusFrames),
+                     InstanceMethod("addPcmFrame", &Detector::AddPCMFrame),
+                     InstanceMethod("removeStream", &Detector::RemoveStream),
+                     InstanceMethod("getStats", &Detector::GetStats)});
 
     exports.Set("Detector", func);
     return exports;
@@ -36,6 +188,7 @@ class Detector : public Napi::ObjectWrap<Detector> {
       std::string error =
           "8 arguments expected. Provided " + std::to_string(arg_count) + ".";
       Napi::TypeError::New(env, error).ThrowAsJavaScriptException();
+      return;
     }
 
     // Arguments are:
@@ -47,6 +200,7 @@ class Detector : public Napi::ObjectWrap<Detector> {
     // Max command audio length (ms)
     // Max silence length when parsing a command
     // Callback for receiving command text data
+    // Optional object with additional settings
 
     if (!info[0].IsString() || !info[1].IsString() || !info[2].IsNumber() ||
         !info[3].IsString() || !info[4].IsNumber() || !info[5].IsNumber() ||
@@ -59,6 +213,7 @@ class Detector : public Napi::ObjectWrap<Detector> {
           "max_command_silence_length_ms: int, "
           "callback: function.")
           .ThrowAsJavaScriptException();
+      return;
     }
 
     // Get arguments
@@ -70,6 +225,19 @@ class Detector : public Napi::ObjectWrap<Detector> {
     config.max_command_length_ms = info[5].ToNumber().Int32Value();
     config.max_command_silence_length_ms = info[6].ToNumber().Int32Value();
 
+    if (arg_count > 8 && !info[8].IsUndefined()) {
+      if (!info[8].IsObject()) {
+        Napi::TypeError::New(env, "Wrong arguments. Expected options: object.")
+            .ThrowAsJavaScriptException();
+        return;
+      }
+      auto options = info[8].As<Napi::Object>();
+      ReadOptions(options);
+      if (env.IsExceptionPending()) {
+        return;
+      }
+    }
+
     // Initialize VoiceManager
     voice_manager = std::make_unique<VoiceManager>(
         config, std::bind(&Detector::SendCommand, this, std::placeholders::_1,
@@ -88,17 +256,117 @@ class Detector : public Napi::ObjectWrap<Detector> {
   std::unique_ptr<VoiceManager> voice_manager;
   AppConfig config;
 
+  // Reads the optional settings into the config
+  void ReadOptions(Napi::Object& options) {
+    config.ingest_ring_size = GetNumberOption<size_t>(
+        options, "ingest_ring_size", config.ingest_ring_size,
+        max_ingest_ring_size, min_ingest_ring_size);
+
+    config.stream_idle_ttl_ms = GetNumberOption<int>(
+        options, "stream_idle_ttl_ms", config.stream_idle_ttl_ms,
+        max_duration_ms);
+
+    config.hotword_max_backlog_ms = GetNumberOption<int>(
+        options, "hotword_max_backlog_ms", config.hotword_max_backlog_ms,
+        max_hotword_backlog_ms);
+    config.pv_prewarm_count = GetNumberOption<size_t>(
+        options, "pv_prewarm_count", config.pv_prewarm_count,
+        max_pv_prewarm_count);
+
+    auto overflow_policy =
+        GetStringOption(options, "ingest_overflow_policy", "spill");
+    if (overflow_policy == "spill") {
+      config.ingest_overflow_policy = IngestOverflowPolicy::Spill;
+    } else if (overflow_policy == "drop") {
+      config.ingest_overflow_policy = IngestOverflowPolicy::Drop;
+    } else {
+      Napi::TypeError::New(
+          options.Env(),
+          "Option ingest_overflow_policy must be \"spill\" or \"drop\".")
+          .ThrowAsJavaScriptException();
+    }
+
+    config.streaming_recognizer_url = GetStringOption(
+        options, "streaming_recognizer_url", config.streaming_recognizer_url);
+
+    config.recognizer_url =
+        GetStringOption(options, "recognizer_url", config.recognizer_url);
+    config.loopback_latency_ms = GetNumberOption<int>(
+        options, "loopback_latency_ms", config.loopback_latency_ms,
+        max_duration_ms);
+    config.loopback_transcript = GetStringOption(
+        options, "loopback_transcript", config.loopback_transcript);
+    config.realtime_threads = GetNumberOption<size_t>(
+        options, "realtime_threads", config.realtime_threads,
+        max_thread_count);
+    config.bulk_threads = GetNumberOption<size_t>(
+        options, "bulk_threads", config.bulk_threads, max_thread_count);
+    config.vad_enabled =
+        GetBoolOption(options, "vad_enabled", config.vad_enabled);
+    config.vad_end_silence_ms = GetNumberOption<int>(
+        options, "vad_end_silence_ms", config.vad_end_silence_ms,
+        max_duration_ms);
+    config.stream_max_backlog_ms = GetNumberOption<int>(
+        options, "stream_max_backlog_ms", config.stream_max_backlog_ms,
+        max_duration_ms);
+    config.max_backlog_ms = GetNumberOption<int>(
+        options, "max_backlog_ms", config.max_backlog_ms, max_duration_ms);
+    config.trace_path =
+        GetStringOption(options, "trace_path", config.trace_path);
+    config.http_connect_timeout_ms = GetNumberOption<int>(
+        options, "http_connect_timeout_ms", config.http_connect_timeout_ms,
+        max_duration_ms);
+    config.http_timeout_ms = GetNumberOption<int>(
+        options, "http_timeout_ms", config.http_timeout_ms, max_duration_ms);
+
+    auto recognizer = GetStringOption(options, "recognizer", "google");
+    if (recognizer == "google") {
+      config.recognizer = RecognizerType::Google;
+    } else if (recognizer == "http") {
+      config.recognizer = RecognizerType::HTTP;
+      if (config.recognizer_url.empty()) {
+        Napi::TypeError::New(
+            options.Env(),
+            "Option recognizer_url is required by the \"http\" recognizer.")
+            .ThrowAsJavaScriptException();
+      }
+    } else if (recognizer == "loopback") {
+      config.recognizer = RecognizerType::Loopback;
+    } else {
+      Napi::TypeError::New(options.Env(),
+                           "Option recognizer must be \"google\", \"http\" or "
+                           "\"loopback\".")
+          .ThrowAsJavaScriptException();
+    }
+
+    auto command_audio_mode =
+        GetStringOption(options, "command_audio_mode", "reencode");
+    if (command_audio_mode == "reencode") {
+      config.command_audio_mode = CommandAudioMode::Reencode;
+    } else if (command_audio_mode == "passthrough") {
+      config.command_audio_mode = CommandAudioMode::Passthrough;
+    } else {
+      Napi::TypeError::New(options.Env(),
+                           "Option command_audio_mode must be \"reencode\" or "
+                           "\"passthrough\".")
+          .ThrowAsJavaScriptException();
+    }
+  }
+
   // Adds an Opus frame to the buffer
-  void AddOpusFrame(const Napi::CallbackInfo& info) {
+  // Returns the ingest status of the frame
+  Napi::Value AddOpusFrame(const Napi::CallbackInfo& info) {
     Napi::Env env = info.Env();
 
     if (info.Length() < 2) {
       Napi::TypeError::New(env, "Wrong number of arguments")
           .ThrowAsJavaScriptException();
+      return env.Undefined();
     }
 
     if (!info[0].IsString() || !info[1].IsBuffer()) {
       Napi::TypeError::New(env, "Wrong arguments").ThrowAsJavaScriptException();
+      return env.Undefined();
     }
 
     // Packet stream identifier
@@ -107,22 +375,237 @@ class Detector : public Napi::ObjectWrap<Detector> {
     // Opus frame
     Napi::Buffer<const opus_byte> opus_buffer =
         info[1].As<Napi::Buffer<const opus_byte>>();
-    auto opus_data_array = opus_buffer.Data();
-    size_t opus_data_length = opus_buffer.Length();
 
-    opus_frame frame(opus_data_array, opus_data_array + opus_data_length);
+    // Submit to handler, the data is copied directly from the JS buffer
+    auto status = voice_manager->AddOpusFrame(id, opus_buffer.Data(),
+                                              opus_buffer.Length());
+    return Napi::String::New(env, GetIngestStatusName(status));
+  };
+
+  // Adds a batch of Opus frames for one or more streams in a single call
+  // Frames are stored back to back in a single buffer and grouped by stream:
+  // the first frame_counts[0] frames belong to ids[0], the next frame_counts[1]
+  // frames to ids[1] and so on
+  // Returns the worst ingest status of every stream's frames
+  Napi::Value AddOpusFrames(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 4) {
+      Napi::TypeError::New(env, "Wrong number of arguments")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    if (!info[0].IsArray() || !IsUint32Array(info[1]) ||
+        !IsUint32Array(info[2]) || !info[3].IsBuffer()) {
+      Napi::TypeError::New(
+          env,
+          "Wrong arguments. Expected ids: string[], frame_counts: Uint32Array, "
+          "frame_lengths: Uint32Array, opus_frames: Buffer.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    auto ids = info[0].As<Napi::Array>();
+    auto frame_counts = info[1].As<Napi::Uint32Array>();
+    auto frame_lengths = info[2].As<Napi::Uint32Array>();
+    auto opus_buffer = info[3].As<Napi::Buffer<const opus_byte>>();
 
-    // Submit to handler
-    voice_manager->AddOpusFrame(id, frame);
+    const uint32_t stream_count = ids.Length();
+    if (frame_counts.ElementLength() != stream_count) {
+      Napi::RangeError::New(env, "frame_counts must have an entry per id.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    // Validate the whole batch before submitting anything, so that a
+    // malformed call doesn't leave partially added streams behind
+    const uint32_t* counts = frame_counts.Data();
+    const uint32_t* lengths = frame_lengths.Data();
+    size_t total_frames = 0;
+    for (uint32_t i = 0; i < stream_count; i++) {
+      if (!ids.Get(i).IsString()) {
+        Napi::TypeError::New(env, "ids must only contain strings.")
+            .ThrowAsJavaScriptException();
+        return env.Undefined();
+      }
+      total_frames += counts[i];
+    }
+
+    if (total_frames != frame_lengths.ElementLength()) {
+      Napi::RangeError::New(
+          env, "frame_lengths must have an entry per frame in frame_counts.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    size_t total_length = 0;
+    for (size_t i = 0; i < total_frames; i++) {
+      total_length += lengths[i];
+    }
+
+    if (total_length > opus_buffer.Length()) {
+      Napi::RangeError::New(env,
+                            "frame_lengths exceed the opus_frames buffer size.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    // Submit every stream's frames in bulk
+    const opus_byte* data = opus_buffer.Data();
+    auto statuses = Napi::Array::New(env, stream_count);
+    for (uint32_t i = 0; i < stream_count; i++) {
+      std::string id = ids.Get(i).As<Napi::String>();
+
+      auto status = voice_manager->AddOpusFrames(id, data, lengths, counts[i]);
+      statuses.Set(i, Napi::String::New(env, GetIngestStatusName(status)));
+
+      for (uint32_t j = 0; j < counts[i]; j++) {
+        data += lengths[j];
+      }
+      lengths += counts[i];
+    }
+
+    return statuses;
   };
 
+  // Adds interleaved 16-bit PCM samples of the specified format to a stream
+  // The audio is downmixed and resampled to the format of the pipeline
+  // Returns the ingest status of the samples
+  Napi::Value AddPCMFrame(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 4) {
+      Napi::TypeError::New(env, "Wrong number of arguments")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    if (!info[0].IsString() || !info[1].IsTypedArray() ||
+        info[1].As<Napi::TypedArray>().TypedArrayType() != napi_int16_array ||
+        !info[2].IsNumber() || !info[3].IsNumber()) {
+      Napi::TypeError::New(
+          env,
+          "Wrong arguments. Expected id: string, samples: Int16Array, "
+          "sample_rate: number, channels: number.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    std::string id = info[0].As<Napi::String>();
+    auto samples = info[1].As<Napi::Int16Array>();
+    const int sample_rate = info[2].As<Napi::Number>().Int32Value();
+    const int channels = info[3].As<Napi::Number>().Int32Value();
+
+    if (!PCMConverter::IsSupported(sample_rate, channels)) {
+      Napi::RangeError::New(env,
+                            "Unsupported PCM format. Expected a sample rate "
+                            "of 8000, 11025, 12000, 16000, 22050, 24000, "
+                            "32000, 44100, 48000, 88200, 96000, 176400 or "
+                            "192000 and 1 to 8 channels.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    if (samples.ElementLength() % channels != 0) {
+      Napi::RangeError::New(
+          env, "samples must contain whole frames of every channel.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    // Converted straight from the JS buffer
+    auto status =
+        voice_manager->AddPCMFrames(id, samples.Data(), samples.ElementLength(),
+                                    sample_rate, channels);
+    return Napi::String::New(env, GetIngestStatusName(status));
+  };
+
+  // Removes a stream and frees its resources
+  // The command that is being spoken is still processed and delivered
+  Napi::Value RemoveStream(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+
+    if (info.Length() < 1 || !info[0].IsString()) {
+      Napi::TypeError::New(env, "Wrong arguments. Expected id: string.")
+          .ThrowAsJavaScriptException();
+      return env.Undefined();
+    }
+
+    std::string id = info[0].As<Napi::String>();
+    return Napi::Boolean::New(env, voice_manager->RemoveStream(id));
+  }
+
+  // Returns a snapshot of the counters, latencies and queue states
+  // Apart from a brief lock for the stream count nothing is locked, so it can
+  // be polled frequently
+  Napi::Value GetStats(const Napi::CallbackInfo& info) {
+    Napi::Env env = info.Env();
+    const auto manager_stats = voice_manager->GetStats();
+
+    auto stats = Napi::Object::New(env);
+    stats.Set("streams", Napi::Number::New(env, manager_stats.stream_count));
+    stats.Set("backlogMs", Napi::Number::New(env, manager_stats.backlog_ms));
+
+    auto queues = Napi::Object::New(env);
+    queues.Set("realtime",
+               QueueToObject(env, manager_stats.realtime_queue_depth,
+                             manager_stats.realtime_queue_wait));
+    queues.Set("bulk", QueueToObject(env, manager_stats.bulk_queue_depth,
+                                     manager_stats.bulk_queue_wait));
+    stats.Set("queues", queues);
+
+    auto counters = Napi::Object::New(env);
+    for (size_t i = 0; i < Metrics::counter_count; i++) {
+      const auto counter = static_cast<Metrics::Counter>(i);
+      counters.Set(Metrics::GetName(counter),
+                   Napi::Number::New(env, Metrics::GetCount(counter)));
+    }
+    stats.Set("counters", counters);
+
+    auto latencies = Napi::Object::New(env);
+    for (size_t i = 0; i < Metrics::stage_count; i++) {
+      const auto stage = static_cast<Metrics::Stage>(i);
+      latencies.Set(Metrics::GetName(stage),
+                    LatencyToObject(env, Metrics::GetSnapshot(stage)));
+    }
+    stats.Set("latencies", latencies);
+
+    return stats;
+  }
+
   // Callback with the detected command text
-  void SendCommand(const std::string& id, const std::string& command_text) {
-    this->node_callback->call([id, command_text](
-                                  Napi::Env env,
-                                  std::vector<napi_value>& args) {
-      args = {Napi::String::New(env, id), Napi::String::New(env, command_text)};
-    });
+  void SendCommand(const std::string& id, const CommandResult& result) {
+    this->node_callback->call(
+        [id, result](Napi::Env env, std::vector<napi_value>& args) {
+          auto info = Napi::Object::New(env);
+          info.Set("isFinal", Napi::Boolean::New(env, result.is_final));
+          info.Set("status",
+                   Napi::String::New(env, GetStatusName(result.status)));
+          info.Set("traceId", Napi::Number::New(env, result.trace_id));
+          if (result.confidence >= 0) {
+            info.Set("confidence", Napi::Number::New(env, result.confidence));
+          }
+
+          auto words = Napi::Array::New(env, result.words.size());
+          for (uint32_t i = 0; i < result.words.size(); i++) {
+            auto word = Napi::Object::New(env);
+            word.Set("word", Napi::String::New(env, result.words[i].word));
+            word.Set("startTime",
+                     Napi::Number::New(env, result.words[i].start_time));
+            word.Set("endTime",
+                     Napi::Number::New(env, result.words[i].end_time));
+            words.Set(i, word);
+          }
+          info.Set("words", words);
+
+          if (result.status == CommandStatus::Error) {
+            info.Set("error", Napi::String::New(env, result.error));
+          }
+
+          args = {Napi::String::New(env, id),
+                  Napi::String::New(env, result.transcript), info};
+        });
   }
 };
 
@@ -6,7 +6,58 @@
 
 // Name alises for common types
 using opus_byte = unsigned char;
-using opus_frame = std::vector<opus_byte>;
 using pcm_frame = int16_t;
 
-using command_callback = std::function<void(std::string&, std::string&)>;
+// Outcome of a command recognition
+enum class CommandStatus {
+  // Speech was recognized
+  Ok,
+  // No speech was recognized
+  Empty,
+  // The recognition failed
+  Error
+};
+
+// Outcome of adding audio to a stream
+enum class IngestStatus {
+  // The audio was queued
+  Ok,
+  // The audio was queued, but the stream or the process is over its backlog
+  // limit, so the streams should be rebalanced
+  Overloaded,
+  // The audio was dropped
+  Dropped
+};
+
+// Recognized word with its offsets from the start of the command audio
+struct CommandWord {
+  std::string word;
+  double start_time = 0;
+  double end_time = 0;
+};
+
+// Recognized text of a command
+struct CommandResult {
+  std::string transcript;
+  // Interim results are followed by more results for the same command
+  bool is_final = true;
+  CommandStatus status = CommandStatus::Ok;
+  // Between 0 and 1, or negative if the recognizer didn't provide one
+  double confidence = -1;
+  // Word offsets, if the recognizer provided them
+  std::vector<CommandWord> words;
+  // Description of the failure for the Error status
+  std::string error;
+  // Identifier of the command in the trace
+  uint64_t trace_id = 0;
+};
+
+using command_callback =
+    std::function<void(const std::string&, const CommandResult&)>;
+
+// Encoded OggOpus command audio along with its format
+struct EncodedAudio {
+  std::vector<unsigned char> data;
+  int sample_rate = 0;
+  int channels = 0;
+};